@@ -1,9 +1,22 @@
 #include <benchmark/benchmark.h>
 #include <fmt/format.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
 #include <univang/format/buffer.hpp>
+#include <univang/format/chrono.hpp>
+#include <univang/format/detail/format_double.hpp>
 #include <univang/format/format.hpp>
 
+#ifndef _WIN32
+#include <unistd.h>
+#include <univang/format/async_file.hpp>
+#endif
+
 static void BM_sprintf(benchmark::State& state) {
     int64_t i = 0;
     for(auto _ : state) {
@@ -136,6 +149,667 @@ static void BM_uint_my_fmt(benchmark::State& state) {
     state.SetItemsProcessed(i);
 }
 
+static uint64_t xorshift(uint64_t& seed) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+// Random value with exactly the given number of decimal digits.
+static uint64_t random_uint_digits(uint64_t& seed, int64_t digits) {
+    uint64_t low = 1;
+    for(int64_t i = 1; i < digits; ++i)
+        low *= 10;
+    uint64_t high = digits == 20 ? UINT64_MAX : low * 10 - 1;
+    if(digits == 1)
+        low = 0;
+    return low + xorshift(seed) % (high - low + 1);
+}
+
+// Random values with exactly state.range(0) decimal digits.
+static std::vector<uint64_t> make_uint_digits(int64_t digits) {
+    std::vector<uint64_t> values(1024);
+    uint64_t seed = 88172645463325252ull;
+    for(auto& v : values)
+        v = random_uint_digits(seed, digits);
+    return values;
+}
+
+// Random values whose digit counts are uniform in [1, state.range(0)], so
+// that the length dependent branches are not predictable.
+static std::vector<uint64_t> make_uint_mixed(int64_t max_digits) {
+    std::vector<uint64_t> values(1024);
+    uint64_t seed = 88172645463325252ull;
+    for(auto& v : values) {
+        auto digits = int64_t(xorshift(seed) % uint64_t(max_digits)) + 1;
+        v = random_uint_digits(seed, digits);
+    }
+    return values;
+}
+
+// Random finite doubles, uniform over the bit patterns.
+static std::vector<double> make_double_random() {
+    std::vector<double> values;
+    uint64_t seed = 88172645463325252ull;
+    while(values.size() < 1024) {
+        auto bits = xorshift(seed) >> 1;
+        if((bits >> 52) == 0x7ff)
+            continue;
+        values.push_back(univang::fmt::detail::bit_cast<double>(bits));
+    }
+    return values;
+}
+
+// Random doubles for which Grisu3 cannot decide the shortest digits and falls
+// back to bignum arithmetic (about 1 in 110).
+static std::vector<double> make_double_grisu_fallback() {
+    std::vector<double> values;
+    uint64_t seed = 88172645463325252ull;
+    while(values.size() < 1024) {
+        auto bits = xorshift(seed) >> 1;
+        if((bits >> 52) == 0x7ff || bits == 0)
+            continue;
+        auto value = univang::fmt::detail::bit_cast<double>(bits);
+        univang::fmt::detail::double_format_context dbl(value);
+        if(!univang::fmt::detail::grisu3_dtoa(dbl))
+            values.push_back(value);
+    }
+    return values;
+}
+
+static void BM_double_random_sprintf(benchmark::State& state) {
+    auto values = make_double_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        sprintf(buf, "%.17g", values[i++ & 1023]);
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_double_random_libfmt(benchmark::State& state) {
+    auto values = make_double_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(fmt::format_to(buf, "{}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_double_random_my_fmt(benchmark::State& state) {
+    auto values = make_double_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_double_fallback_libfmt(benchmark::State& state) {
+    auto values = make_double_grisu_fallback();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(fmt::format_to(buf, "{}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_double_fallback_my_fmt(benchmark::State& state) {
+    auto values = make_double_grisu_fallback();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+// Random doubles in [1e-5, 1e5) with all 53 significand bits set randomly.
+static std::vector<double> make_double_prices() {
+    std::vector<double> values(1024);
+    uint64_t seed = 88172645463325252ull;
+    for(auto& v : values) {
+        auto scale = double(xorshift(seed) % 10);
+        v = double(xorshift(seed) >> 11) / double(uint64_t(1) << 53)
+            * std::pow(10.0, scale - 5);
+    }
+    return values;
+}
+
+static void BM_double_fixed_libfmt(benchmark::State& state) {
+    auto values = make_double_prices();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(
+            fmt::format_to(buf, "{:.20f}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_double_fixed_my_fmt(benchmark::State& state) {
+    auto values = make_double_prices();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{:.20f}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_double_precision_libfmt(benchmark::State& state) {
+    auto values = make_double_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(
+            fmt::format_to(buf, "{:.17e}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_double_precision_my_fmt(benchmark::State& state) {
+    auto values = make_double_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{:.17e}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_double_hex_libfmt(benchmark::State& state) {
+    auto values = make_double_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(
+            fmt::format_to(buf, "{:a}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_double_hex_my_fmt(benchmark::State& state) {
+    auto values = make_double_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{:a}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+// A CSV column of 1024 doubles.
+static void BM_double_column_libfmt(benchmark::State& state) {
+    auto values = make_double_random();
+    std::string str;
+    for(auto _ : state) {
+        str.clear();
+        fmt::format_to(std::back_inserter(str), "{}", fmt::join(values, ","));
+        benchmark::DoNotOptimize(str.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * str.size()));
+}
+
+static void BM_double_column_each_my_fmt(benchmark::State& state) {
+    auto values = make_double_random();
+    std::string str;
+    for(auto _ : state) {
+        str.clear();
+        univang::fmt::string_format_context out(str);
+        for(size_t i = 0; i < values.size(); ++i)
+            univang::fmt::format_to(out, i != 0 ? ",{}" : "{}", values[i]);
+        out.finalize();
+        benchmark::DoNotOptimize(str.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * str.size()));
+}
+
+static void BM_double_column_my_fmt(benchmark::State& state) {
+    auto values = make_double_random();
+    std::string str;
+    for(auto _ : state) {
+        str.clear();
+        univang::fmt::string_format_context out(str);
+        univang::fmt::format_doubles(
+            out, values.data(), values.size(), univang::fmt::format_spec(),
+            ",");
+        out.finalize();
+        benchmark::DoNotOptimize(str.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * str.size()));
+}
+
+// A tensor dump of 1024 half precision values in [-8, 8).
+static std::vector<univang::fmt::float16> make_float16_tensor() {
+    std::vector<univang::fmt::float16> values(1024);
+    uint64_t seed = 88172645463325252ull;
+    for(auto& v : values) {
+        auto bits = xorshift(seed);
+        // Sign and fraction bits with a biased exponent in [8, 17].
+        auto exponent = 8 + bits % 10;
+        v.bits = uint16_t((bits >> 8 & 0x83ff) | exponent << 10);
+    }
+    return values;
+}
+
+static void BM_float16_column_widened_my_fmt(benchmark::State& state) {
+    auto values = make_float16_tensor();
+    std::string str;
+    for(auto _ : state) {
+        str.clear();
+        univang::fmt::string_format_context out(str);
+        for(size_t i = 0; i < values.size(); ++i)
+            univang::fmt::format_to(
+                out, i != 0 ? ",{}" : "{}", values[i].to_double());
+        out.finalize();
+        benchmark::DoNotOptimize(str.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * str.size()));
+}
+
+static void BM_float16_column_my_fmt(benchmark::State& state) {
+    auto values = make_float16_tensor();
+    std::string str;
+    for(auto _ : state) {
+        str.clear();
+        univang::fmt::string_format_context out(str);
+        univang::fmt::format_doubles(
+            out, values.data(), values.size(), univang::fmt::format_spec(),
+            ",");
+        out.finalize();
+        benchmark::DoNotOptimize(str.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * str.size()));
+}
+
+// Random long doubles with full 64-bit significands in [1e-100, 1e100).
+static std::vector<long double> make_long_double_random() {
+    std::vector<long double> values;
+    uint64_t seed = 88172645463325252ull;
+    while(values.size() < 1024) {
+        auto bits = xorshift(seed) | 1ull << 63;
+        auto exponent = int(xorshift(seed) % 660) - 393;
+        values.push_back(std::ldexp(static_cast<long double>(bits), exponent));
+    }
+    return values;
+}
+
+static void BM_long_double_sprintf(benchmark::State& state) {
+    auto values = make_long_double_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        sprintf(buf, "%Lg", values[i++ & 1023]);
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_long_double_my_fmt(benchmark::State& state) {
+    auto values = make_long_double_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{:.6g}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_long_double_shortest_my_fmt(benchmark::State& state) {
+    auto values = make_long_double_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+// Prices in cents, as double and as decimal64.
+static void BM_price_double_my_fmt(benchmark::State& state) {
+    auto values = make_uint_mixed(8);
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(univang::fmt::format_to(
+            buf, "{:.2f}", double(values[i++ & 1023]) / 100));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_price_decimal_my_fmt(benchmark::State& state) {
+    auto values = make_uint_mixed(8);
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        univang::fmt::decimal64 price{int64_t(values[i++ & 1023]), 2};
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{:.2f}", price));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_uint_digits_libfmt(benchmark::State& state) {
+    auto values = make_uint_digits(state.range(0));
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(
+            fmt::format_to(buf, "{}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_uint_digits_my_fmt(benchmark::State& state) {
+    auto values = make_uint_digits(state.range(0));
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        univang::fmt::format_context out(buf, sizeof(buf));
+        univang::fmt::append(out, values[i++ & 1023]);
+        benchmark::DoNotOptimize(out.size());
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_uint_mixed_sprintf(benchmark::State& state) {
+    auto values = make_uint_mixed(state.range(0));
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(sprintf(
+            buf, "%llu", static_cast<unsigned long long>(values[i++ & 1023])));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_uint_mixed_libfmt(benchmark::State& state) {
+    auto values = make_uint_mixed(state.range(0));
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(
+            fmt::format_to(buf, "{}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_uint_mixed_my_fmt(benchmark::State& state) {
+    auto values = make_uint_mixed(state.range(0));
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_uint_mixed_append(benchmark::State& state) {
+    auto values = make_uint_mixed(state.range(0));
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        univang::fmt::format_context out(buf, sizeof(buf));
+        univang::fmt::append(out, values[i++ & 1023]);
+        benchmark::DoNotOptimize(out.size());
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+// Random 64-bit values such as trace ids.
+static std::vector<uint64_t> make_uint_random() {
+    std::vector<uint64_t> values(1024);
+    uint64_t seed = 88172645463325252ull;
+    for(auto& v : values)
+        v = xorshift(seed);
+    return values;
+}
+
+static void BM_hex_sprintf(benchmark::State& state) {
+    auto values = make_uint_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(sprintf(
+            buf, "%016llx",
+            static_cast<unsigned long long>(values[i++ & 1023])));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_hex_libfmt(benchmark::State& state) {
+    auto values = make_uint_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(
+            fmt::format_to(buf, "{:016x}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_hex_my_fmt(benchmark::State& state) {
+    auto values = make_uint_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{:016x}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_bin_my_fmt(benchmark::State& state) {
+    auto values = make_uint_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[80];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{:b}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_pointer_my_fmt(benchmark::State& state) {
+    auto values = make_uint_random();
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        univang::fmt::format_context out(buf, sizeof(buf));
+        univang::fmt::append(
+            out, reinterpret_cast<const void*>(values[i++ & 1023]));
+        benchmark::DoNotOptimize(out.size());
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_uint_grouped_my_fmt(benchmark::State& state) {
+    auto values = make_uint_mixed(20);
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{:n}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_uint_padded_libfmt(benchmark::State& state) {
+    auto values = make_uint_mixed(9);
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(
+            fmt::format_to(buf, "{:09}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_uint_padded_my_fmt(benchmark::State& state) {
+    auto values = make_uint_mixed(9);
+    size_t i = 0;
+    for(auto _ : state) {
+        char buf[32];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{:09}", values[i++ & 1023]));
+    }
+    state.SetItemsProcessed(int64_t(i));
+}
+
+static void BM_time_point_my_fmt(benchmark::State& state) {
+    auto tp = std::chrono::system_clock::now();
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(univang::fmt::format_to(buf, "{}", tp));
+        tp += std::chrono::microseconds(1);
+    }
+}
+
+// Timestamps of log lines: the second changes rarely.
+static void BM_time_point_now_my_fmt(benchmark::State& state) {
+    int64_t i = 0;
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(univang::fmt::format_to(
+            buf, "{}", std::chrono::system_clock::now()));
+        ++i;
+    }
+    state.SetItemsProcessed(i);
+}
+
+static void BM_time_point_spec_my_fmt(benchmark::State& state) {
+    auto tp = std::chrono::system_clock::now();
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(univang::fmt::format_to(
+            buf, "{:%Y-%m-%d %H:%M:%S.%3f}", tp));
+        tp += std::chrono::microseconds(1);
+    }
+}
+
+static void BM_time_point_strftime(benchmark::State& state) {
+    auto tp = std::chrono::system_clock::now();
+    for(auto _ : state) {
+        char buf[64];
+        auto t = std::chrono::system_clock::to_time_t(tp);
+        std::tm tm;
+        gmtime_r(&t, &tm);
+        auto len = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      tp.time_since_epoch())
+                      .count()
+                  % 1000;
+        benchmark::DoNotOptimize(
+            std::snprintf(buf + len, sizeof(buf) - len, ".%03d", int(ms)));
+        tp += std::chrono::microseconds(1);
+    }
+}
+
+static void BM_time_point_zone_my_fmt(benchmark::State& state) {
+    const auto& zone = univang::fmt::time_zone::locate("Europe/Berlin");
+    auto tp = std::chrono::system_clock::now();
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(univang::fmt::format_to(
+            buf, "{}", univang::fmt::in_zone(tp, zone)));
+        tp += std::chrono::microseconds(1);
+    }
+}
+
+static void BM_time_point_localtime_r(benchmark::State& state) {
+    setenv("TZ", "Europe/Berlin", 1);
+    tzset();
+    auto tp = std::chrono::system_clock::now();
+    for(auto _ : state) {
+        char buf[64];
+        auto t = std::chrono::system_clock::to_time_t(tp);
+        std::tm tm;
+        localtime_r(&t, &tm);
+        benchmark::DoNotOptimize(
+            std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S%z", &tm));
+        tp += std::chrono::microseconds(1);
+    }
+    unsetenv("TZ");
+    tzset();
+}
+
+static void BM_time_point_precision_my_fmt(benchmark::State& state) {
+    auto tp = std::chrono::system_clock::now();
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(univang::fmt::format_to(buf, "{:.3}", tp));
+        tp += std::chrono::microseconds(1);
+    }
+}
+
+static void BM_duration_my_fmt(benchmark::State& state) {
+    std::chrono::nanoseconds dur(3723004005006);
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(univang::fmt::format_to(buf, "{}", dur));
+        dur += std::chrono::nanoseconds(1);
+    }
+}
+
+static void BM_duration_unit_my_fmt(benchmark::State& state) {
+    std::chrono::nanoseconds dur(3723004005006);
+    for(auto _ : state) {
+        char buf[64];
+        benchmark::DoNotOptimize(
+            univang::fmt::format_to(buf, "{:.3ms}", dur));
+        dur += std::chrono::nanoseconds(1);
+    }
+}
+
+static void BM_join_libfmt(benchmark::State& state) {
+    auto values = make_uint_mixed(20);
+    std::string str;
+    for(auto _ : state) {
+        str.clear();
+        fmt::format_to(std::back_inserter(str), "{}", fmt::join(values, ", "));
+        benchmark::DoNotOptimize(str.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * str.size()));
+}
+
+// Element by element through format_arg.
+static void BM_join_each_my_fmt(benchmark::State& state) {
+    auto values = make_uint_mixed(20);
+    std::string str;
+    for(auto _ : state) {
+        str.clear();
+        univang::fmt::string_format_context out(str);
+        for(size_t i = 0; i < values.size(); ++i)
+            univang::fmt::format_to(out, i != 0 ? ", {}" : "{}", values[i]);
+        out.finalize();
+        benchmark::DoNotOptimize(str.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * str.size()));
+}
+
+static void BM_join_my_fmt(benchmark::State& state) {
+    auto values = make_uint_mixed(20);
+    std::string str;
+    for(auto _ : state) {
+        str.clear();
+        univang::fmt::append(str, univang::fmt::join(values, ", "));
+        benchmark::DoNotOptimize(str.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * str.size()));
+}
+
 static void BM_str_sprintf(benchmark::State& state) {
     int64_t i = 0;
     for(auto _ : state) {
@@ -146,6 +820,87 @@ static void BM_str_sprintf(benchmark::State& state) {
     state.SetItemsProcessed(i);
 }
 
+#ifndef _WIN32
+// Synchronous counterpart of async_file_context: grow() writes in place.
+class sync_file_context : public univang::fmt::format_context {
+public:
+    sync_file_context(int fd, size_t size, bool datasync)
+        : storage_(size), fd_(fd), datasync_(datasync) {
+        assign(storage_.data(), storage_.size());
+    }
+    ~sync_file_context() {
+        flush();
+    }
+    void grow(size_t /*new_capacity*/) final {
+        flush();
+    }
+
+private:
+    void flush() {
+        if(::write(fd_, data(), size()) < 0)
+            throw std::runtime_error("write failed");
+        if(datasync_)
+            ::fdatasync(fd_);
+        clear();
+    }
+
+    std::vector<byte> storage_;
+    int fd_;
+    bool datasync_;
+};
+
+// Measures every append and reports latency percentiles as counters.
+template<class Context>
+static void append_latency(benchmark::State& state, Context& out) {
+    using clock = std::chrono::steady_clock;
+    std::vector<uint32_t> latencies;
+    latencies.reserve(1 << 20);
+    int64_t i = 0;
+    for(auto _ : state) {
+        auto start = clock::now();
+        univang::fmt::format_to(
+            out, "{} [info] request {} served in {}us: {}\n", i, 42u, 15.25,
+            "GET /index.html");
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      clock::now() - start)
+                      .count();
+        if(latencies.size() < latencies.capacity())
+            latencies.push_back(uint32_t(ns));
+        ++i;
+    }
+    state.SetItemsProcessed(i);
+    if(latencies.empty())
+        return;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return double(latencies[size_t(p * (latencies.size() - 1))]);
+    };
+    state.counters["p50_ns"] = percentile(0.5);
+    state.counters["p99_ns"] = percentile(0.99);
+    state.counters["p999_ns"] = percentile(0.999);
+    state.counters["max_ns"] = latencies.back();
+}
+
+static void BM_file_sync(benchmark::State& state) {
+    std::FILE* file = std::tmpfile();
+    {
+        sync_file_context out(fileno(file), 1 << 16, state.range(0) != 0);
+        append_latency(state, out);
+    }
+    std::fclose(file);
+}
+
+static void BM_file_async(benchmark::State& state) {
+    std::FILE* file = std::tmpfile();
+    {
+        univang::fmt::async_file_context out(
+            fileno(file), 1 << 16, 4, state.range(0) != 0);
+        append_latency(state, out);
+    }
+    std::fclose(file);
+}
+#endif
+
 // Register the function as a benchmark
 BENCHMARK(BM_sprintf);
 BENCHMARK(BM_libfmt);
@@ -156,8 +911,59 @@ BENCHMARK(BM_doublef_my_fmt);
 BENCHMARK(BM_doubleg_sprintf);
 BENCHMARK(BM_doubleg_libfmt);
 BENCHMARK(BM_doubleg_my_fmt);
+BENCHMARK(BM_double_random_sprintf);
+BENCHMARK(BM_double_random_libfmt);
+BENCHMARK(BM_double_random_my_fmt);
+BENCHMARK(BM_double_fallback_libfmt);
+BENCHMARK(BM_double_fallback_my_fmt);
+BENCHMARK(BM_double_fixed_libfmt);
+BENCHMARK(BM_double_fixed_my_fmt);
+BENCHMARK(BM_double_precision_libfmt);
+BENCHMARK(BM_double_precision_my_fmt);
+BENCHMARK(BM_double_hex_libfmt);
+BENCHMARK(BM_double_hex_my_fmt);
+BENCHMARK(BM_double_column_libfmt);
+BENCHMARK(BM_double_column_each_my_fmt);
+BENCHMARK(BM_double_column_my_fmt);
+BENCHMARK(BM_float16_column_widened_my_fmt);
+BENCHMARK(BM_float16_column_my_fmt);
+BENCHMARK(BM_long_double_sprintf);
+BENCHMARK(BM_long_double_my_fmt);
+BENCHMARK(BM_long_double_shortest_my_fmt);
+BENCHMARK(BM_price_double_my_fmt);
+BENCHMARK(BM_price_decimal_my_fmt);
 BENCHMARK(BM_uint_sprintf);
 BENCHMARK(BM_uint_libfmt);
 BENCHMARK(BM_uint_my_fmt);
+BENCHMARK(BM_uint_digits_libfmt)->DenseRange(1, 20);
+BENCHMARK(BM_uint_digits_my_fmt)->DenseRange(1, 20);
+BENCHMARK(BM_uint_mixed_sprintf)->Arg(10)->Arg(20);
+BENCHMARK(BM_uint_mixed_libfmt)->Arg(10)->Arg(20);
+BENCHMARK(BM_uint_mixed_my_fmt)->Arg(10)->Arg(20);
+BENCHMARK(BM_uint_mixed_append)->Arg(10)->Arg(20);
+BENCHMARK(BM_hex_sprintf);
+BENCHMARK(BM_hex_libfmt);
+BENCHMARK(BM_hex_my_fmt);
+BENCHMARK(BM_bin_my_fmt);
+BENCHMARK(BM_pointer_my_fmt);
+BENCHMARK(BM_uint_grouped_my_fmt);
+BENCHMARK(BM_uint_padded_libfmt);
+BENCHMARK(BM_uint_padded_my_fmt);
+BENCHMARK(BM_time_point_my_fmt);
+BENCHMARK(BM_time_point_now_my_fmt);
+BENCHMARK(BM_time_point_spec_my_fmt);
+BENCHMARK(BM_time_point_strftime);
+BENCHMARK(BM_time_point_zone_my_fmt);
+BENCHMARK(BM_time_point_localtime_r);
+BENCHMARK(BM_time_point_precision_my_fmt);
+BENCHMARK(BM_duration_my_fmt);
+BENCHMARK(BM_duration_unit_my_fmt);
+BENCHMARK(BM_join_libfmt);
+BENCHMARK(BM_join_each_my_fmt);
+BENCHMARK(BM_join_my_fmt);
+#ifndef _WIN32
+BENCHMARK(BM_file_sync)->Arg(0)->Arg(1);
+BENCHMARK(BM_file_async)->Arg(0)->Arg(1);
+#endif
 
 BENCHMARK_MAIN();
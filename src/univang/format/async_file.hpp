@@ -0,0 +1,33 @@
+#pragma once
+#include <memory>
+
+#include "format_context.hpp"
+
+namespace univang {
+namespace fmt {
+
+// Context that formats into one of several large buffers while a background
+// thread writes the filled ones to a file descriptor. grow() hands the
+// current buffer over to the writer and continues in a free one, blocking
+// only while all buffers are in flight.
+class async_file_context : public format_context {
+public:
+    explicit async_file_context(
+        int fd, size_t buffer_size = 1 << 20, unsigned buffer_count = 2,
+        bool datasync = false);
+    ~async_file_context();
+
+    void grow(size_t new_capacity) final;
+    // Hands the pending output over to the writer thread.
+    void flush();
+    // Flushes and waits until all output is written. Throws
+    // std::system_error if the writer failed.
+    void sync();
+
+private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+} // namespace fmt
+} // namespace univang
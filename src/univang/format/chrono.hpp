@@ -1,27 +1,303 @@
 #pragma once
 #include <chrono>
 #include "format.hpp"
+#include "tz.hpp"
 
 namespace univang {
 namespace fmt {
 
+// strftime-like conversion spec compiled into a list of fixed width field
+// writers, without strftime and the C locale. A constexpr chrono_spec is
+// compiled at compile time; the specs of replacement fields, such as
+// "{:%Y-%m-%d %H:%M:%S.%3f}", are compiled once per thread and cached.
+//
+// The spec starts with a conversion. Conversions of time points:
+//   %Y %y %m %d %e %j  year, 2-digit year, month, day, space padded day,
+//                      day of the year
+//   %H %I %M %S %p     hour, 12-hour clock hour, minute, second, AM/PM
+//   %a %b %u %w        weekday and month abbreviation, weekday 1-7 from
+//                      Monday and 0-6 from Sunday
+//   %F %T %R %D        %Y-%m-%d, %H:%M:%S, %H:%M, %m/%d/%y
+//   %f %Nf             6 or N digits of the fraction of the second
+//   %z %Z              offset from UTC as +hhmm, zone abbreviation
+//   %n %t %%           newline, tab, '%'
+// Durations take the time of day conversions %H %M %S %T %R and the
+// fraction; their hours are not bounded by a day.
+class chrono_spec {
+public:
+    enum class field : uint8_t {
+        literal,
+        year,
+        year2,
+        month,
+        day,
+        day_space,
+        day_of_year,
+        hour,
+        hour12,
+        minute,
+        second,
+        am_pm,
+        weekday_name,
+        month_name,
+        weekday_iso,
+        weekday,
+        fraction,
+        utc_offset,
+        zone_name,
+    };
+    struct item {
+        field kind;
+        // Width of the field, digits of the fraction, maximum width of the
+        // zone abbreviation.
+        uint8_t width;
+        // Literal bytes in text().
+        uint8_t offset;
+    };
+
+    static constexpr size_t max_source_size = 64;
+    static constexpr size_t max_items = 32;
+
+    constexpr chrono_spec() noexcept = default;
+    constexpr explicit chrono_spec(std::string_view source) noexcept {
+        if(source.size() > max_source_size) {
+            fail("chrono spec too long");
+            return;
+        }
+        for(size_t i = 0; i < source.size(); ++i)
+            text_[i] = source[i];
+        source_size_ = uint8_t(source.size());
+        if(source.empty() || source[0] != '%') {
+            fail("invalid chrono spec");
+            return;
+        }
+        size_t pos = 0;
+        while(pos < source.size() && valid()) {
+            if(source[pos] != '%') {
+                add_literal(pos++);
+                continue;
+            }
+            if(++pos == source.size()) {
+                fail("invalid chrono spec");
+                break;
+            }
+            uint8_t digits = 6;
+            if(source[pos] >= '1' && source[pos] <= '9'
+               && pos + 1 < source.size() && source[pos + 1] == 'f') {
+                digits = uint8_t(source[pos++] - '0');
+            }
+            add_conversion(source[pos], pos, digits);
+            ++pos;
+        }
+    }
+
+    constexpr bool valid() const noexcept {
+        return error_ == nullptr;
+    }
+    constexpr const char* error() const noexcept {
+        return error_;
+    }
+    constexpr std::string_view source() const noexcept {
+        return {text_, source_size_};
+    }
+    // The source and, past max_source_size, the bytes of %n, %t and the
+    // separators of the composite conversions.
+    constexpr const char* text() const noexcept {
+        return text_;
+    }
+    constexpr const item* begin() const noexcept {
+        return items_;
+    }
+    constexpr const item* end() const noexcept {
+        return items_ + item_count_;
+    }
+    // Upper bound of the output size of a time point.
+    constexpr size_t max_size() const noexcept {
+        return max_size_;
+    }
+    // Upper bound of the output size of a duration, whose hours take up to
+    // 20 digits each.
+    constexpr size_t max_duration_size() const noexcept {
+        return max_size_ + hour_count_ * size_t(18);
+    }
+    // True if the spec has conversions that durations do not take.
+    constexpr bool has_date() const noexcept {
+        return has_date_;
+    }
+
+private:
+    // Not constexpr: an invalid spec compiled at compile time does not
+    // compile.
+    void fail(const char* message) noexcept {
+        error_ = message;
+        item_count_ = 0;
+    }
+
+    constexpr void add(field kind, uint8_t width, size_t offset = 0) noexcept {
+        if(!valid())
+            return;
+        if(item_count_ == max_items)
+            return fail("chrono spec too long");
+        items_[item_count_++] = {kind, width, uint8_t(offset)};
+        max_size_ += width;
+        if(kind == field::hour)
+            ++hour_count_;
+    }
+
+    // Literal bytes that follow each other in source() share an item.
+    constexpr void add_literal(size_t offset) noexcept {
+        if(item_count_ != 0) {
+            auto& last = items_[item_count_ - 1];
+            if(last.kind == field::literal
+               && last.offset + last.width == offset) {
+                ++last.width;
+                ++max_size_;
+                return;
+            }
+        }
+        add(field::literal, 1, offset);
+    }
+
+    constexpr void add_date(field kind, uint8_t width) noexcept {
+        has_date_ = true;
+        add(kind, width);
+    }
+
+    constexpr void add_conversion(
+        char conversion, size_t pos, uint8_t digits) noexcept {
+        switch(conversion) {
+        case 'Y':
+            return add_date(field::year, 4);
+        case 'y':
+            return add_date(field::year2, 2);
+        case 'm':
+            return add_date(field::month, 2);
+        case 'd':
+            return add_date(field::day, 2);
+        case 'e':
+            return add_date(field::day_space, 2);
+        case 'j':
+            return add_date(field::day_of_year, 3);
+        case 'H':
+            return add(field::hour, 2);
+        case 'I':
+            return add_date(field::hour12, 2);
+        case 'M':
+            return add(field::minute, 2);
+        case 'S':
+            return add(field::second, 2);
+        case 'p':
+            return add_date(field::am_pm, 2);
+        case 'a':
+            return add_date(field::weekday_name, 3);
+        case 'b':
+            return add_date(field::month_name, 3);
+        case 'u':
+            return add_date(field::weekday_iso, 1);
+        case 'w':
+            return add_date(field::weekday, 1);
+        case 'f':
+            return add(field::fraction, digits);
+        case 'z':
+            return add_date(field::utc_offset, 5);
+        case 'Z':
+            return add_date(
+                field::zone_name, sizeof(time_zone::info::abbrev));
+        case '%':
+            return add_literal(pos);
+        case 'n':
+            return add_separator('\n');
+        case 't':
+            return add_separator('\t');
+        case 'F':
+            add_date(field::year, 4);
+            add_separator('-');
+            add_date(field::month, 2);
+            add_separator('-');
+            return add_date(field::day, 2);
+        case 'D':
+            add_date(field::month, 2);
+            add_separator('/');
+            add_date(field::day, 2);
+            add_separator('/');
+            return add_date(field::year2, 2);
+        case 'T':
+            add(field::hour, 2);
+            add_separator(':');
+            add(field::minute, 2);
+            add_separator(':');
+            return add(field::second, 2);
+        case 'R':
+            add(field::hour, 2);
+            add_separator(':');
+            return add(field::minute, 2);
+        default:
+            return fail("invalid chrono spec");
+        }
+    }
+
+    // Literal bytes that are not in the source, stored past it.
+    constexpr void add_separator(char c) noexcept {
+        if(text_size_ == sizeof(text_))
+            return fail("chrono spec too long");
+        text_[text_size_] = c;
+        add(field::literal, 1, text_size_++);
+    }
+
+    char text_[max_source_size + 32] = {};
+    uint8_t source_size_ = 0;
+    uint8_t text_size_ = max_source_size;
+    item items_[max_items] = {};
+    uint8_t item_count_ = 0;
+    bool has_date_ = false;
+    uint16_t max_size_ = 0;
+    uint8_t hour_count_ = 0;
+    const char* error_ = nullptr;
+};
+
 namespace detail {
 
 using seconds = std::chrono::seconds;
 using nanoseconds = std::chrono::nanoseconds;
 
 void append_time_point(format_context& out, seconds sec, nanoseconds ns);
+// Local time of the zone followed by its offset from UTC.
+void append_time_point(
+    format_context& out, seconds sec, nanoseconds ns, const time_zone& zone);
+// Without a zone the time is UTC.
+void format_time_point(
+    format_context& out, const chrono_spec& spec, seconds sec,
+    nanoseconds ns, const time_zone* zone = nullptr);
+// Formats with the spec in fmt, ISO 8601 if it is empty.
+void format_time_point(
+    parse_context& fmt, format_context& out, seconds sec, nanoseconds ns,
+    const time_zone* zone = nullptr);
+
+template<class Clock, class Duration>
+seconds epoch_seconds(const std::chrono::time_point<Clock, Duration>& tp) {
+    return std::chrono::floor<seconds>(tp.time_since_epoch());
+}
+
+template<class Clock, class Duration>
+nanoseconds subsecond(const std::chrono::time_point<Clock, Duration>& tp) {
+    return std::chrono::duration_cast<nanoseconds>(
+        tp - std::chrono::floor<seconds>(tp));
+}
 
 template<class Clock, class Duration>
 inline void append(
     format_context& out, const std::chrono::time_point<Clock, Duration>& tp) {
     detail::append_time_point(
-        out, seconds(Clock::to_time_t(tp)),
-        std::chrono::duration_cast<nanoseconds>(
-            tp - std::chrono::floor<seconds>(tp)));
+        out, detail::epoch_seconds(tp), detail::subsecond(tp));
 }
 
 void append_duration(format_context& out, seconds sec, nanoseconds ns);
+// Throws std::invalid_argument for a spec with date conversions.
+void format_duration(
+    format_context& out, const chrono_spec& spec, seconds sec,
+    nanoseconds ns);
+void format_duration(
+    parse_context& fmt, format_context& out, seconds sec, nanoseconds ns);
 template<class Rep, class Period>
 void append(
     format_context& out, const std::chrono::duration<Rep, Period>& dur) {
@@ -36,21 +312,116 @@ void append(
         std::chrono::duration_cast<nanoseconds>(dur % seconds(1)));
 }
 
+template<class Rep, class Period>
+void format_duration(
+    parse_context& fmt, format_context& out,
+    const std::chrono::duration<Rep, Period>& dur) {
+    using in_duration = std::chrono::duration<Rep, Period>;
+
+    if(fmt.eof())
+        return detail::append(out, dur);
+    if(dur == in_duration::max())
+        return detail::format_duration(fmt, out, seconds::max(), {});
+    if(dur == in_duration::min())
+        return detail::format_duration(fmt, out, seconds::min(), {});
+    detail::format_duration(
+        fmt, out, std::chrono::duration_cast<seconds>(dur),
+        std::chrono::duration_cast<nanoseconds>(dur % seconds(1)));
+}
+
 } // namespace detail
 
+// A time point formatted as the local time of a zone:
+//     fmt::format("{}", fmt::in_zone(tp));  // 2000-02-29T13:34:56+01:00
+//     fmt::format("{:%F %T %Z}", fmt::in_zone(tp, time_zone::utc()));
+template<class Clock, class Duration>
+struct zoned_time {
+    std::chrono::time_point<Clock, Duration> time;
+    const time_zone& zone;
+};
+
+template<class Clock, class Duration>
+zoned_time<Clock, Duration> in_zone(
+    const std::chrono::time_point<Clock, Duration>& tp,
+    const time_zone& zone = time_zone::local()) {
+    return {tp, zone};
+}
+
+// A time point or duration formatted with a compiled spec:
+//     static constexpr fmt::chrono_spec hms("%T.%3f");
+//     fmt::format("{} {}", fmt::with_spec(tp, hms), message);
+template<class T>
+struct chrono_spec_view {
+    const T& value;
+    const chrono_spec& spec;
+};
+
+template<class T>
+chrono_spec_view<T> with_spec(const T& value, const chrono_spec& spec) {
+    return {value, spec};
+}
+
+// Besides a chrono_spec, time points take ".N": ISO 8601 with exactly N
+// digits of the fraction of the second, 0 <= N <= 9. Durations take
+// "[.N][unit]" with a unit of d, h, m, s, ms, us or ns: the duration as a
+// count of the unit, or as "1d 2h 3m 4.5s" without one. By default the
+// fraction has no trailing zeros.
 template<class Clock, class Duration>
 struct formatter<std::chrono::time_point<Clock, Duration>> {
     using time_point = std::chrono::time_point<Clock, Duration>;
-    void format(format_context& out, const time_point& tp) {
-        detail::append(out, tp);
+    void format(parse_context& fmt, format_context& out, const time_point& tp) {
+        detail::format_time_point(
+            fmt, out, detail::epoch_seconds(tp), detail::subsecond(tp));
     }
 };
 
 template<class Rep, class Period>
 struct formatter<std::chrono::duration<Rep, Period>> {
     using duration = std::chrono::duration<Rep, Period>;
-    void format(format_context& out, const duration& dur) {
-        detail::append(out, dur);
+    void format(parse_context& fmt, format_context& out, const duration& dur) {
+        detail::format_duration(fmt, out, dur);
+    }
+};
+
+template<class Clock, class Duration>
+struct formatter<chrono_spec_view<std::chrono::time_point<Clock, Duration>>> {
+    using view = chrono_spec_view<std::chrono::time_point<Clock, Duration>>;
+    void format(format_context& out, const view& v) {
+        detail::format_time_point(
+            out, v.spec, detail::epoch_seconds(v.value),
+            detail::subsecond(v.value));
+    }
+};
+
+template<class Clock, class Duration>
+struct formatter<zoned_time<Clock, Duration>> {
+    void format(
+        parse_context& fmt, format_context& out,
+        const zoned_time<Clock, Duration>& zt) {
+        detail::format_time_point(
+            fmt, out, detail::epoch_seconds(zt.time),
+            detail::subsecond(zt.time), &zt.zone);
+    }
+};
+
+template<class Clock, class Duration>
+struct formatter<chrono_spec_view<zoned_time<Clock, Duration>>> {
+    using view = chrono_spec_view<zoned_time<Clock, Duration>>;
+    void format(format_context& out, const view& v) {
+        detail::format_time_point(
+            out, v.spec, detail::epoch_seconds(v.value.time),
+            detail::subsecond(v.value.time), &v.value.zone);
+    }
+};
+
+template<class Rep, class Period>
+struct formatter<chrono_spec_view<std::chrono::duration<Rep, Period>>> {
+    using view = chrono_spec_view<std::chrono::duration<Rep, Period>>;
+    void format(format_context& out, const view& v) {
+        detail::format_duration(
+            out, v.spec, std::chrono::duration_cast<detail::seconds>(v.value),
+            std::chrono::duration_cast<detail::nanoseconds>(
+                v.value % detail::seconds(1)));
     }
 };
 
@@ -0,0 +1,149 @@
+#include <univang/format/async_file.hpp>
+
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace univang {
+namespace fmt {
+
+struct async_file_context::impl {
+    struct chunk {
+        byte* data;
+        size_t size;
+    };
+
+    impl(int fd, size_t buffer_size, unsigned buffer_count, bool datasync)
+        : fd(fd), buffer_size(buffer_size), datasync(datasync) {
+        storage.resize(buffer_count);
+        for(auto& buffer : storage) {
+            buffer.reset(new byte[buffer_size]);
+            free.push_back(buffer.get());
+        }
+        thread = std::thread([this] { run(); });
+    }
+
+    ~impl() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        ready.notify_one();
+        thread.join();
+    }
+
+    // Queues a filled buffer for writing.
+    void push(byte* data, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(size != 0) {
+            pending.push_back({data, size});
+            ready.notify_one();
+        }
+        else
+            free.push_back(data);
+    }
+
+    // Returns a free buffer, waiting for the writer when none is left.
+    byte* acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [this] { return !free.empty(); });
+        auto* buffer = free.back();
+        free.pop_back();
+        return buffer;
+    }
+
+    void wait_written() {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [this] { return pending.empty(); });
+        if(error != 0)
+            throw std::system_error(
+                error, std::generic_category(), "async_file_context");
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            ready.wait(lock, [this] { return stop || !pending.empty(); });
+            if(pending.empty())
+                return;
+            auto chunk = pending.front();
+            lock.unlock();
+            int err = write_all(chunk.data, chunk.size);
+            lock.lock();
+            if(err != 0 && error == 0)
+                error = err;
+            pending.pop_front();
+            free.push_back(chunk.data);
+            released.notify_all();
+        }
+    }
+
+    int write_all(const byte* data, size_t size) {
+        while(size != 0) {
+            auto res = ::write(fd, data, size);
+            if(res < 0) {
+                if(errno == EINTR)
+                    continue;
+                return errno;
+            }
+            data += res;
+            size -= size_t(res);
+        }
+        if(datasync && ::fdatasync(fd) != 0)
+            return errno;
+        return 0;
+    }
+
+    int fd;
+    size_t buffer_size;
+    bool datasync;
+    std::vector<std::unique_ptr<byte[]>> storage;
+    std::mutex mutex;
+    // Signals the writer about pending buffers or stop.
+    std::condition_variable ready;
+    // Signals the producer about written buffers.
+    std::condition_variable released;
+    std::deque<chunk> pending;
+    std::vector<byte*> free;
+    bool stop = false;
+    int error = 0;
+    std::thread thread;
+};
+
+async_file_context::async_file_context(
+    int fd, size_t buffer_size, unsigned buffer_count, bool datasync)
+    : impl_(new impl(
+        fd, (std::max)(buffer_size, max_ensure_size),
+        (std::max)(buffer_count, 2u), datasync)) {
+    assign(impl_->acquire(), impl_->buffer_size);
+}
+
+async_file_context::~async_file_context() {
+    impl_->push(data(), size());
+}
+
+void async_file_context::grow(size_t /*new_capacity*/) {
+    if(empty())
+        return;
+    flush();
+}
+
+void async_file_context::flush() {
+    impl_->push(data(), size());
+    clear();
+    assign(impl_->acquire(), impl_->buffer_size);
+}
+
+void async_file_context::sync() {
+    flush();
+    impl_->wait_written();
+}
+
+} // namespace fmt
+} // namespace univang
@@ -1,5 +1,10 @@
-#include <univang/format/buffer.hpp>
 #include <univang/format/chrono.hpp>
+#include "format_integer.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
 
 namespace univang {
 namespace fmt {
@@ -35,9 +40,9 @@ constexpr calendar_date_t make_calendar_date(days days_since_epoch) noexcept {
     return {year, month, day};
 }
 
+// Days are floored, so that times before the epoch fall on their own day.
 constexpr calendar_date_t date_from_epoch(seconds epoch_s) noexcept {
-    return detail::make_calendar_date(
-        std::chrono::duration_cast<days>(epoch_s));
+    return detail::make_calendar_date(std::chrono::floor<days>(epoch_s));
 }
 
 // time of a day
@@ -48,6 +53,7 @@ struct time_of_day_t {
 };
 
 constexpr time_of_day_t day_time_from_epoch(seconds epoch_s) noexcept {
+    epoch_s -= std::chrono::floor<days>(epoch_s);
     auto h = static_cast<uint8_t>(
         std::chrono::duration_cast<hours>(epoch_s % days(1)).count());
     auto m = static_cast<uint8_t>(
@@ -56,94 +62,485 @@ constexpr time_of_day_t day_time_from_epoch(seconds epoch_s) noexcept {
     return {h, m, s};
 }
 
-void append_time_point(format_context& out, seconds sec, nanoseconds ns) {
-    auto d = date_from_epoch(sec);
-    auto t = day_time_from_epoch(sec);
-    char tmp[30] = {char('0' + (d.y / 1000) % 10),
-                    char('0' + (d.y / 100) % 10),
-                    char('0' + (d.y / 10) % 10),
-                    char('0' + (d.y % 10)),
-                    '-',
-                    char('0' + (d.m / 10) % 10),
-                    char('0' + (d.m % 10)),
-                    '-',
-                    char('0' + (d.d / 10) % 10),
-                    char('0' + (d.d % 10)),
-                    'T',
-                    char('0' + (t.h / 10) % 10),
-                    char('0' + (t.h % 10)),
-                    ':',
-                    char('0' + (t.m / 10) % 10),
-                    char('0' + (t.m % 10)),
-                    ':',
-                    char('0' + (t.s / 10) % 10),
-                    char('0' + (t.s % 10))};
-    size_t len = 19;
-    if(ns.count() != 0) {
-        tmp[len++] = '.';
-        uint32_t u = static_cast<uint32_t>(ns.count());
-        uint32_t f = 1000000000;
-        do {
-            auto digit = (u / f) % 10;
-            tmp[len++] = char('0' + digit);
-            u %= f;
-            f /= 10;
-        } while(u != 0);
+// Writes the nine digits of a nanosecond fraction without trailing zeros.
+template<class Char>
+size_t write_fraction(Char* out, uint32_t ns) noexcept {
+    write_dec_fixed<9>(out, ns);
+    size_t len = 9;
+    while(out[len - 1] == Char('0'))
+        --len;
+    return len;
+}
+
+// Writes '.' and the first precision of the nine digits of ns, or the
+// digits without trailing zeros if precision < 0. Writes nothing if there
+// are no digits. Needs room for ten bytes.
+template<class Char>
+size_t write_fraction(Char* out, uint32_t ns, int precision) noexcept {
+    if(precision == 0 || (precision < 0 && ns == 0))
+        return 0;
+    out[0] = Char('.');
+    if(precision < 0)
+        return 1 + write_fraction(out + 1, ns);
+    write_dec_fixed<9>(out + 1, ns);
+    return 1 + size_t(precision);
+}
+
+namespace {
+
+// Date and time of the second formatted last by this thread. Timestamps of
+// log lines change second rarely, so most of them only copy these bytes.
+struct timestamp_cache {
+    // Every second is a valid key, so emptiness is kept apart.
+    bool valid = false;
+    seconds::rep second = 0;
+    char text[19];
+};
+
+thread_local timestamp_cache last_timestamp;
+
+} // namespace
+
+// Writes +hhmm or +hh:mm; seconds of the offset are dropped.
+template<class Char>
+size_t write_utc_offset(Char* out, int32_t offset, bool colon) noexcept {
+    out[0] = Char(offset < 0 ? '-' : '+');
+    auto minutes = unsigned(offset < 0 ? -offset : offset) / 60;
+    write_dec_fixed<2>(out + 1, minutes / 60);
+    if(colon)
+        out[3] = Char(':');
+    write_dec_fixed<2>(out + 3 + colon, minutes % 60);
+    return 5 + colon;
+}
+
+// Writes the date and time of sec in at most 29 bytes.
+size_t write_timestamp(
+    char* out, seconds sec, nanoseconds ns, int precision) noexcept {
+    auto& cache = last_timestamp;
+    if(!cache.valid || sec.count() != cache.second) {
+        auto d = date_from_epoch(sec);
+        auto t = day_time_from_epoch(sec);
+        char* text = cache.text;
+        write_dec_fixed<4>(text, d.y % 10000);
+        text[4] = '-';
+        write_dec_fixed<2>(text + 5, d.m);
+        text[7] = '-';
+        write_dec_fixed<2>(text + 8, d.d);
+        text[10] = 'T';
+        write_dec_fixed<2>(text + 11, t.h);
+        text[13] = ':';
+        write_dec_fixed<2>(text + 14, t.m);
+        text[16] = ':';
+        write_dec_fixed<2>(text + 17, t.s);
+        cache.second = sec.count();
+        cache.valid = true;
     }
+    std::memcpy(out, cache.text, sizeof(cache.text));
+    auto len = sizeof(cache.text);
+    return len + write_fraction(
+                     out + len, static_cast<uint32_t>(ns.count()), precision);
+}
+
+// ISO 8601 in UTC or in the local time of the zone followed by its offset.
+void append_timestamp(
+    format_context& out, seconds sec, nanoseconds ns, const time_zone* zone,
+    int precision) {
+    char tmp[35];
+    if(zone == nullptr)
+        return out.write(tmp, write_timestamp(tmp, sec, ns, precision));
+    const auto& info = zone->lookup(sec);
+    auto len = write_timestamp(tmp, sec + seconds(info.offset), ns, precision);
+    len += write_utc_offset(tmp + len, info.offset, true);
     out.write(tmp, len);
 }
 
-void append_duration(format_context& out, seconds sec, nanoseconds ns) {
-    if(sec.count() == 0 && ns.count() == 0) {
-        append(out, '0');
-        return;
+void append_time_point(format_context& out, seconds sec, nanoseconds ns) {
+    append_timestamp(out, sec, ns, nullptr, -1);
+}
+
+void append_time_point(
+    format_context& out, seconds sec, nanoseconds ns, const time_zone& zone) {
+    append_timestamp(out, sec, ns, &zone, -1);
+}
+
+namespace {
+
+constexpr char weekday_names[] = "SunMonTueWedThuFriSat";
+constexpr char month_names[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+constexpr uint16_t days_before_month[] = {
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+constexpr bool is_leap_year(unsigned y) noexcept {
+    return y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+}
+
+constexpr time_zone::info utc_info = {0, false, 3, {'U', 'T', 'C'}};
+
+// Values of the fields of a chrono_spec. For durations hour is the total
+// count of hours and the date fields are unused, but kept a valid date.
+struct chrono_fields {
+    calendar_date_t date = {1970, 1, 1};
+    unsigned weekday = 0;
+    unsigned day_of_year = 0;
+    uint64_t hour = 0;
+    unsigned minute = 0;
+    unsigned second = 0;
+    uint32_t ns = 0;
+    const time_zone::info* zone = &utc_info;
+};
+
+template<class Char>
+Char* write_chrono_fields(
+    Char* p, const chrono_spec& spec, const chrono_fields& f) noexcept {
+    using field = chrono_spec::field;
+    for(const auto& item : spec) {
+        switch(item.kind) {
+        case field::literal:
+            // Mostly single separators, too short for a memcpy call.
+            for(unsigned i = 0; i < item.width; ++i)
+                p[i] = Char(spec.text()[item.offset + i]);
+            break;
+        case field::year:
+            write_dec_fixed<4>(p, f.date.y % 10000u);
+            break;
+        case field::year2:
+            write_dec_fixed<2>(p, f.date.y % 100u);
+            break;
+        case field::month:
+            write_dec_fixed<2>(p, f.date.m);
+            break;
+        case field::day:
+            write_dec_fixed<2>(p, f.date.d);
+            break;
+        case field::day_space:
+            write_dec_fixed<2>(p, f.date.d);
+            if(f.date.d < 10)
+                p[0] = Char(' ');
+            break;
+        case field::day_of_year:
+            write_dec_fixed<3>(p, f.day_of_year);
+            break;
+        case field::hour:
+            if(f.hour >= 100) {
+                auto len = count_digits(f.hour);
+                write_dec(p, len, f.hour);
+                p += len;
+                continue;
+            }
+            write_dec_fixed<2>(p, unsigned(f.hour));
+            break;
+        case field::hour12:
+            write_dec_fixed<2>(p, f.hour % 12 != 0 ? f.hour % 12 : 12);
+            break;
+        case field::minute:
+            write_dec_fixed<2>(p, f.minute);
+            break;
+        case field::second:
+            write_dec_fixed<2>(p, f.second);
+            break;
+        case field::am_pm:
+            std::memcpy(p, f.hour < 12 ? "AM" : "PM", 2);
+            break;
+        case field::weekday_name:
+            std::memcpy(p, weekday_names + 3 * f.weekday, 3);
+            break;
+        case field::month_name:
+            std::memcpy(p, month_names + 3 * (f.date.m - 1), 3);
+            break;
+        case field::weekday_iso:
+            p[0] = Char('0' + (f.weekday == 0 ? 7 : f.weekday));
+            break;
+        case field::weekday:
+            p[0] = Char('0' + f.weekday);
+            break;
+        case field::fraction:
+            // All nine digits; the caller reserves room for the excess.
+            write_dec_fixed<9>(p, f.ns);
+            break;
+        case field::utc_offset:
+            write_utc_offset(p, f.zone->offset, false);
+            break;
+        case field::zone_name:
+            for(unsigned i = 0; i < f.zone->abbrev_size; ++i)
+                p[i] = Char(f.zone->abbrev[i]);
+            p += f.zone->abbrev_size;
+            continue;
+        }
+        p += item.width;
     }
-    fs_buffer<256> tmp;
+    return p;
+}
+
+// Specs of replacement fields compiled by this thread, direct mapped by a
+// hash of the spec.
+struct chrono_spec_cache {
+    static constexpr size_t size = 8;
+    chrono_spec entries[size];
+};
+
+thread_local chrono_spec_cache chrono_specs;
 
-    if(sec.count() < 0) {
-        append(tmp, '-');
-        sec = -sec;
-        ns = -ns;
+const chrono_spec& cached_chrono_spec(std::string_view source) noexcept {
+    // Too long to be kept for comparison; any such spec compiles to the
+    // same error, so the first one is compiled once for all.
+    if(source.size() > chrono_spec::max_source_size) {
+        static const chrono_spec too_long(source);
+        return too_long;
     }
-    bool first = true;
-    if(sec >= days(1)) {
-        append_inline(tmp, std::chrono::duration_cast<days>(sec).count(), 'd');
-        sec %= days(1);
-        first = false;
+    // Specs rarely agree in size, in the last byte and in the middle one.
+    auto hash = source.size() * 7 + static_cast<unsigned char>(source.back())
+                + static_cast<unsigned char>(source[source.size() / 2]);
+    auto& entry = chrono_specs.entries[hash % chrono_spec_cache::size];
+    if(entry.source() != source)
+        entry = chrono_spec(source);
+    return entry;
+}
+
+std::string_view spec_text(const parse_context& fmt) noexcept {
+    return {reinterpret_cast<const char*>(fmt.begin()), fmt.size()};
+}
+
+// Consumes ".N" with 0 <= N <= 9 at the start of spec.
+bool parse_precision(std::string_view& spec, int& precision) noexcept {
+    if(spec.size() < 2 || spec[0] != '.' || spec[1] < '0' || spec[1] > '9')
+        return false;
+    precision = spec[1] - '0';
+    spec.remove_prefix(2);
+    return true;
+}
+
+enum class duration_unit : uint8_t {
+    composite,
+    days,
+    hours,
+    minutes,
+    seconds,
+    milliseconds,
+    microseconds,
+    nanoseconds,
+};
+
+constexpr std::string_view unit_suffixes[] = {
+    "", "d", "h", "m", "s", "ms", "us", "ns"};
+
+// Seconds of the units from days to seconds.
+constexpr uint64_t unit_seconds[] = {1, 86400, 3600, 60, 1};
+// Decimal digits of nanoseconds in a unit, from seconds to nanoseconds.
+constexpr unsigned unit_ns_digits[] = {9, 6, 3, 0};
+constexpr uint32_t pow10_u32[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+    1000000000};
+
+// Duration spec other than a chrono_spec: [.N][unit]. A duration with a
+// unit is written as a single count of it, otherwise as "1d 2h 3m 4.5s".
+struct duration_format {
+    duration_unit unit = duration_unit::composite;
+    int precision = -1;
+};
+
+bool parse_duration_format(std::string_view spec, duration_format& f) {
+    if(!spec.empty() && spec[0] == '.' && !parse_precision(spec, f.precision))
+        return false;
+    for(size_t i = 1; i < std::size(unit_suffixes); ++i) {
+        if(spec == unit_suffixes[i]) {
+            f.unit = duration_unit(i);
+            return true;
+        }
     }
-    if(sec >= hours(1)) {
-        if(!first)
-            append(tmp, ' ');
-        append_inline(tmp, std::chrono::duration_cast<hours>(sec).count(), 'h');
-        sec %= hours(1);
-        first = false;
+    return spec.empty();
+}
+
+template<class Char>
+Char* write_count(Char* out, uint64_t value) noexcept {
+    auto len = count_digits(value);
+    write_dec(out, len, value);
+    return out + len;
+}
+
+// Largest output of write_duration().
+constexpr size_t max_duration_size = 48;
+
+// Writes s seconds and ns nanoseconds of a duration.
+template<class Char>
+Char* write_duration(
+    Char* p, uint64_t s, uint32_t ns, const duration_format& f) noexcept {
+    const auto unit = size_t(f.unit);
+    // Nanoseconds of the fraction of the unit scaled to nine digits.
+    uint32_t fraction;
+    if(f.unit == duration_unit::composite) {
+        if(s == 0 && ns == 0 && f.precision < 0) {
+            *p++ = Char('0');
+            return p;
+        }
+        auto* start = p;
+        constexpr char suffixes[] = {'d', 'h', 'm'};
+        for(size_t i = 0; i < 3; ++i) {
+            if(s < unit_seconds[i + 1])
+                continue;
+            if(p != start)
+                *p++ = Char(' ');
+            p = write_count(p, s / unit_seconds[i + 1]);
+            *p++ = Char(suffixes[i]);
+            s %= unit_seconds[i + 1];
+        }
+        if(s == 0 && ns == 0 && f.precision < 0)
+            return p;
+        if(p != start)
+            *p++ = Char(' ');
+        p = write_count(p, s);
+        p += write_fraction(p, ns, f.precision);
+        *p++ = Char('s');
+        return p;
     }
-    if(sec >= minutes(1)) {
-        if(!first)
-            append(tmp, ' ');
-        append_inline(
-            tmp, std::chrono::duration_cast<minutes>(sec).count(), 'm');
-        sec %= minutes(1);
-        first = false;
+    if(f.unit >= duration_unit::milliseconds) {
+        // s followed by the fixed width digits of the units in ns.
+        auto digits = unit_ns_digits[unit - size_t(duration_unit::seconds)];
+        auto count = ns / pow10_u32[digits];
+        if(s != 0) {
+            p = write_count(p, s);
+            write_dec_width(p, 9 - digits, count);
+            p += 9 - digits;
+        }
+        else
+            p = write_count(p, count);
+        fraction = ns % pow10_u32[digits] * pow10_u32[9 - digits];
     }
-    if(sec.count() != 0 || ns.count() != 0) {
-        if(!first)
-            append(tmp, ' ');
-        append(tmp, sec.count());
-        if(ns.count() != 0) {
-            append(tmp, '.');
-            uint32_t u = static_cast<uint32_t>(ns.count());
-            uint32_t f = std::nano::den;
-            do {
-                auto digit = (u / f) % 10;
-                append(tmp, char('0' + digit));
-                u %= f;
-                f /= 10;
-            } while(u != 0);
+    else {
+        auto unit_s = unit_seconds[unit];
+        p = write_count(p, s / unit_s);
+        // Three digits of the remainder at a time; it is below 8.64e13.
+        uint64_t unit_ns = unit_s * 1000000000;
+        uint64_t rem = s % unit_s * 1000000000 + ns;
+        fraction = 0;
+        for(int i = 0; i < 3; ++i) {
+            rem *= 1000;
+            fraction = fraction * 1000 + uint32_t(rem / unit_ns);
+            rem %= unit_ns;
         }
-        append(tmp, 's');
     }
-    out.write(tmp.data(), tmp.size());
+    p += write_fraction(p, fraction, f.precision);
+    auto suffix = unit_suffixes[unit];
+    for(size_t i = 0; i < suffix.size(); ++i)
+        p[i] = Char(suffix[i]);
+    return p + suffix.size();
+}
+
+void append_duration(
+    format_context& out, seconds sec, nanoseconds ns,
+    const duration_format& f) {
+    bool negative = sec.count() < 0 || ns.count() < 0;
+    // Negating seconds::min() would overflow.
+    auto s = negative ? 0 - static_cast<uint64_t>(sec.count())
+                      : static_cast<uint64_t>(sec.count());
+    auto n = static_cast<uint32_t>(negative ? -ns.count() : ns.count());
+    out.ensure(max_duration_size);
+    auto* p = out.pos();
+    if(negative)
+        *p++ = format_context::byte('-');
+    p = write_duration(p, s, n, f);
+    out.advance(size_t(p - out.pos()));
+}
+
+} // namespace
+
+void format_time_point(
+    format_context& out, const chrono_spec& spec, seconds sec,
+    nanoseconds ns, const time_zone* zone) {
+    chrono_fields f;
+    if(zone != nullptr) {
+        f.zone = &zone->lookup(sec);
+        sec += seconds(f.zone->offset);
+    }
+    auto day = std::chrono::floor<days>(sec);
+    if(spec.has_date()) {
+        f.date = make_calendar_date(day);
+        // 1970-01-01 was a Thursday.
+        f.weekday = unsigned((day.count() % 7 + 11) % 7);
+        f.day_of_year = days_before_month[f.date.m - 1] + f.date.d
+                        + (f.date.m > 2 && is_leap_year(f.date.y));
+    }
+    auto t = day_time_from_epoch(sec - day);
+    f.hour = t.h;
+    f.minute = t.m;
+    f.second = t.s;
+    f.ns = static_cast<uint32_t>(ns.count());
+    out.ensure(spec.max_size() + 8);
+    auto* p = write_chrono_fields(out.pos(), spec, f);
+    out.advance(size_t(p - out.pos()));
+}
+
+void format_time_point(
+    parse_context& fmt, format_context& out, seconds sec, nanoseconds ns,
+    const time_zone* zone) {
+    if(fmt.eof())
+        return append_timestamp(out, sec, ns, zone, -1);
+    auto text = spec_text(fmt);
+    if(text[0] == '.') {
+        int precision;
+        if(!parse_precision(text, precision) || !text.empty())
+            return fmt.on_error("invalid chrono spec");
+        return append_timestamp(out, sec, ns, zone, precision);
+    }
+    const auto& spec = cached_chrono_spec(spec_text(fmt));
+    if(!spec.valid())
+        return fmt.on_error(spec.error());
+    format_time_point(out, spec, sec, ns, zone);
+}
+
+void format_duration(
+    format_context& out, const chrono_spec& spec, seconds sec,
+    nanoseconds ns) {
+    // A duration has no date to fill the date fields from.
+    if(spec.has_date())
+        throw std::invalid_argument("invalid duration spec");
+    bool negative = sec.count() < 0 || ns.count() < 0;
+    // Negating seconds::min() would overflow; its hours are in range.
+    auto s = negative ? 0 - static_cast<uint64_t>(sec.count())
+                      : static_cast<uint64_t>(sec.count());
+    chrono_fields f;
+    f.hour = s / 3600;
+    f.minute = unsigned(s / 60 % 60);
+    f.second = unsigned(s % 60);
+    f.ns = static_cast<uint32_t>(negative ? -ns.count() : ns.count());
+    // The sign and the excess of the fraction.
+    auto size = spec.max_duration_size() + 9;
+    if(size > format_context::max_ensure_size) {
+        // Many %H, each up to 20 digits.
+        char buffer[1024];
+        assert(size <= sizeof(buffer));
+        char* p = buffer;
+        if(negative)
+            *p++ = '-';
+        p = write_chrono_fields(p, spec, f);
+        return out.write(buffer, size_t(p - buffer));
+    }
+    out.ensure(size);
+    auto* p = out.pos();
+    if(negative)
+        *p++ = format_context::byte('-');
+    p = write_chrono_fields(p, spec, f);
+    out.advance(size_t(p - out.pos()));
+}
+
+void format_duration(
+    parse_context& fmt, format_context& out, seconds sec, nanoseconds ns) {
+    auto text = spec_text(fmt);
+    if(text[0] != '%') {
+        duration_format f;
+        if(!parse_duration_format(text, f))
+            return fmt.on_error("invalid duration spec");
+        return append_duration(out, sec, ns, f);
+    }
+    const auto& spec = cached_chrono_spec(spec_text(fmt));
+    if(!spec.valid())
+        return fmt.on_error(spec.error());
+    if(spec.has_date())
+        return fmt.on_error("invalid duration spec");
+    format_duration(out, spec, sec, ns);
+}
+
+void append_duration(format_context& out, seconds sec, nanoseconds ns) {
+    append_duration(out, sec, ns, duration_format());
 }
 
 } // namespace detail
@@ -7,6 +7,8 @@
 #include "format_integer.hpp"
 #include "format_parsing.hpp"
 
+#include <atomic>
+
 namespace univang {
 namespace fmt {
 namespace detail {
@@ -18,6 +20,14 @@ struct append_handler {
     void operator()(const format_arg::handle& v) {
         v.format_fn(out, dummy_fmt, v.ptr);
     }
+    void operator()(const long double* v) {
+        ::univang::fmt::append(out, *v);
+    }
+#ifdef __SIZEOF_FLOAT128__
+    void operator()(const __float128* v) {
+        ::univang::fmt::append(out, *v);
+    }
+#endif
     template<class T>
     void operator()(const T& v) {
         ::univang::fmt::append(out, v);
@@ -32,14 +42,20 @@ struct format_handler {
     }
     template<class T>
     void format_int(T arg) {
-        if(!do_format_int(out, spec, arg))
+        bool valid = false;
+        write_reserved(out, max_num_size<T> + spec.width, [&](auto& dest) {
+            valid = do_format_int(dest, spec, arg);
+        });
+        if(!valid)
             fmt.on_error("invalid numeric type");
     }
     void format_str(std::string_view v) {
         // TODO: utf-8 specialization
         if(!spec.align)
             spec.align = '<';
-        detail::write_padded(out, spec, padded_string(v));
+        write_reserved(out, v.size() + spec.width, [&](auto& dest) {
+            detail::write_padded(dest, spec, padded_string(v));
+        });
     }
     void operator()(bool arg) {
         format_str(arg ? "true" : "false");
@@ -79,6 +95,36 @@ struct format_handler {
             detail::do_format_double(out, spec, arg);
         }
     }
+    void operator()(const long double* arg) {
+        if(!validate_float_spec(spec))
+            fmt.on_error("invalid floating type");
+        else
+            detail::do_format_long_double(out, spec, *arg);
+    }
+#ifdef __SIZEOF_FLOAT128__
+    void operator()(const __float128* arg) {
+        if(!validate_float_spec(spec))
+            fmt.on_error("invalid floating type");
+        else
+            detail::do_format_float128(out, spec, *arg);
+    }
+#endif
+    void format_narrow(double arg, const narrow_format& narrow) {
+        if(!validate_float_spec(spec))
+            fmt.on_error("invalid floating type");
+        else
+            detail::do_format_double(out, spec, arg, &narrow);
+    }
+    void operator()(float16 arg) {
+        format_narrow(arg.to_double(), binary16_format);
+    }
+    void operator()(bfloat16 arg) {
+        format_narrow(arg.to_double(), bfloat16_format);
+    }
+    void operator()(decimal64 arg) {
+        if(!do_format_decimal(out, spec, arg))
+            fmt.on_error("invalid decimal type");
+    }
     void operator()(const char* arg) {
         if(spec.type == 'p')
             return operator()((const void*)arg);
@@ -97,9 +143,168 @@ struct format_handler {
     format_spec spec;
 };
 
+// Context storing the bytes of each step past its first skip ones into a
+// caller buffer and, once it is full, up to spill_size more into spill.
+// Output past those is dropped and marks the step as truncated.
+class window_context : public format_context {
+public:
+    window_context(
+        void* buf, size_t size, std::string& spill, size_t spill_size) noexcept
+        : format_context(buf, size)
+        , buf_(static_cast<byte*>(buf))
+        , buf_size_(size)
+        , spill_(spill)
+        , spill_size_(spill_size) {
+    }
+    void grow(size_t /*new_capacity*/) noexcept final {
+        flush();
+        assign(scratch_, sizeof(scratch_));
+    }
+    void start_step(size_t skip) noexcept {
+        skip_ = skip;
+        captured_ = 0;
+        truncated_ = false;
+        if(skip_ == 0 && !full())
+            assign(buf_ + stored_, buf_size_ - stored_);
+        else
+            assign(scratch_, sizeof(scratch_));
+    }
+    void flush() noexcept {
+        if(data() != scratch_) {
+            stored_ += size();
+            captured_ += size();
+            clear();
+            return;
+        }
+        auto* p = reinterpret_cast<const char*>(scratch_);
+        auto count = size();
+        auto skipped = (std::min)(count, skip_);
+        skip_ -= skipped;
+        p += skipped;
+        count -= skipped;
+        auto stored = (std::min)(count, buf_size_ - stored_);
+        std::memcpy(buf_ + stored_, p, stored);
+        stored_ += stored;
+        p += stored;
+        count -= stored;
+        auto spilled = (std::min)(count, spill_size_ - spill_.size());
+        spill_.append(p, spilled);
+        captured_ += stored + spilled;
+        truncated_ = truncated_ || spilled < count;
+        clear();
+    }
+    bool truncated() const noexcept {
+        return truncated_;
+    }
+    bool full() const noexcept {
+        return stored_ == buf_size_;
+    }
+    // Bytes of the step stored into the buffer or the spill.
+    size_t captured() const noexcept {
+        return captured_;
+    }
+    size_t stored() const noexcept {
+        return stored_;
+    }
+
+private:
+    byte* buf_;
+    size_t buf_size_;
+    std::string& spill_;
+    size_t spill_size_;
+    size_t stored_ = 0;
+    size_t skip_ = 0;
+    size_t captured_ = 0;
+    bool truncated_ = false;
+    byte scratch_[max_ensure_size];
+};
+
+bool on_format_error(
+    format_context& out, format_parse_context& fmt, const char* err) {
+    if(!fmt.fail())
+        fmt.on_error(err);
+    out.write(std::string_view(err));
+    return false;
+}
+
+// Formats the literal text up to the next replacement field and the field
+// itself. Returns false once the format string is consumed; a parse error is
+// written as the last output.
+bool format_next(format_context& out, format_parse_context& fmt) {
+    if(fmt.eof())
+        return false;
+    const auto* p = fmt.find('{');
+    if(p == nullptr) {
+        out.write(fmt.begin(), fmt.size());
+        fmt.advance_to(fmt.end());
+        return true;
+    }
+    out.write(fmt.begin(), p - fmt.begin());
+    fmt.advance_to(p + 1);
+    if(fmt.eof())
+        return on_format_error(out, fmt, "invalid format string");
+    if(fmt.consume('{')) {
+        out.write('{');
+        return true;
+    }
+    unsigned arg_pos = parse_arg_ref(fmt);
+    if(fmt.fail())
+        return on_format_error(out, fmt, fmt.error());
+    if(!fmt.is_char('}') && (!fmt.consume(':') || fmt.eof()))
+        return on_format_error(out, fmt, "invalid format string");
+    const auto& arg = fmt.get_arg(arg_pos);
+    if(fmt.consume('}')) {
+        std::visit(append_handler(out), arg);
+    }
+    else if(!std::holds_alternative<format_arg::handle>(arg)) {
+        format_handler handler{out, fmt};
+        if(parse_format_spec(fmt, handler.spec))
+            std::visit(handler, arg);
+    }
+    else {
+        p = fmt.find('}');
+        if(p == nullptr)
+            return on_format_error(out, fmt, "invalid format string");
+        auto& handle = std::get<format_arg::handle>(arg);
+        parse_context arg_fmt{fmt.pos(), size_t(p - fmt.pos())};
+        fmt.advance_to(p + 1);
+        handle.format_fn(out, arg_fmt, handle.ptr);
+        if(arg_fmt.fail())
+            return on_format_error(out, fmt, arg_fmt.error());
+    }
+    if(fmt.fail())
+        return on_format_error(out, fmt, fmt.error());
+    return true;
+}
+
 } // namespace
 } // namespace detail
 
+namespace {
+// Groupings are never modified or freed once published, so a formatting
+// thread may keep using the one it loaded while another sets a new one.
+// Each links the one it replaced, which keeps them all reachable.
+struct published_grouping {
+    digit_grouping grouping;
+    const published_grouping* previous;
+};
+const published_grouping default_grouping = {};
+std::atomic<const published_grouping*> current_grouping{&default_grouping};
+} // namespace
+
+void set_digit_grouping(const digit_grouping& grouping) {
+    auto* published = new published_grouping{
+        grouping, current_grouping.load(std::memory_order_relaxed)};
+    while(!current_grouping.compare_exchange_weak(
+        published->previous, published, std::memory_order_release,
+        std::memory_order_relaxed)) {
+    }
+}
+
+const digit_grouping& get_digit_grouping() noexcept {
+    return current_grouping.load(std::memory_order_acquire)->grouping;
+}
+
 // Append integers.
 void append(format_context& out, int arg) {
     detail::append_dec(out, arg);
@@ -125,6 +330,59 @@ void append(format_context& out, unsigned long long arg) {
     detail::append_dec(out, arg);
 }
 
+// Append integer arrays.
+void append_join(
+    format_context& out, const int* v, size_t count, std::string_view sep) {
+    detail::append_join(out, v, count, sep);
+}
+
+void append_join(
+    format_context& out, const unsigned int* v, size_t count,
+    std::string_view sep) {
+    detail::append_join(out, v, count, sep);
+}
+
+void append_join(
+    format_context& out, const long* v, size_t count, std::string_view sep) {
+    detail::append_join(out, v, count, sep);
+}
+
+void append_join(
+    format_context& out, const unsigned long* v, size_t count,
+    std::string_view sep) {
+    detail::append_join(out, v, count, sep);
+}
+
+void append_join(
+    format_context& out, const long long* v, size_t count,
+    std::string_view sep) {
+    detail::append_join(out, v, count, sep);
+}
+
+void append_join(
+    format_context& out, const unsigned long long* v, size_t count,
+    std::string_view sep) {
+    detail::append_join(out, v, count, sep);
+}
+
+void format_doubles(
+    format_context& out, const double* v, size_t count,
+    const format_spec& spec, std::string_view sep) {
+    detail::format_doubles(out, v, count, spec, sep);
+}
+
+void format_doubles(
+    format_context& out, const float16* v, size_t count,
+    const format_spec& spec, std::string_view sep) {
+    detail::format_doubles(out, v, count, spec, sep);
+}
+
+void format_doubles(
+    format_context& out, const bfloat16* v, size_t count,
+    const format_spec& spec, std::string_view sep) {
+    detail::format_doubles(out, v, count, spec, sep);
+}
+
 // Append float.
 void append(format_context& out, double arg) {
     format_spec empty_spec;
@@ -132,17 +390,46 @@ void append(format_context& out, double arg) {
     detail::do_format_double(out, empty_spec, arg);
 }
 
+void append(format_context& out, long double arg) {
+    format_spec empty_spec;
+    detail::do_format_long_double(out, empty_spec, arg);
+}
+
+#ifdef __SIZEOF_FLOAT128__
+void append(format_context& out, __float128 arg) {
+    format_spec empty_spec;
+    detail::do_format_float128(out, empty_spec, arg);
+}
+#endif
+
+// Append half precision floats.
+void append(format_context& out, float16 arg) {
+    format_spec empty_spec;
+    detail::do_format_double(
+        out, empty_spec, arg.to_double(), &detail::binary16_format);
+}
+
+void append(format_context& out, bfloat16 arg) {
+    format_spec empty_spec;
+    detail::do_format_double(
+        out, empty_spec, arg.to_double(), &detail::bfloat16_format);
+}
+
+// Append fixed point decimal.
+void append(format_context& out, decimal64 arg) {
+    format_spec empty_spec;
+    detail::do_format_decimal(out, empty_spec, arg);
+}
+
 // Append pointer.
 void append(format_context& out, const void* v) {
     auto u = reinterpret_cast<uintptr_t>(v);
     constexpr unsigned width = sizeof(u) * 2;
-    format_context::byte tmp[width];
-    auto pos = detail::write_int(tmp, sizeof(tmp), u, 16);
     out.ensure(width + 2);
     out.add('0');
     out.add('x');
-    out.add_padding('0', pos);
-    out.add(tmp + pos, width - pos);
+    detail::write_hex(out.pos(), width, u);
+    out.advance(width);
 }
 
 void vappend_to(format_context& out, format_arg_span args) {
@@ -173,51 +460,51 @@ void vappend_to(std::string& str, delim_t delim, format_arg_span args) {
 void vformat_to(
     format_context& out, std::string_view format_str, format_arg_span args) {
     detail::format_parse_context fmt{format_str, args};
-    while(!fmt.eof()) {
-        const auto* p = fmt.find('{');
-        if(p == nullptr)
-            return out.write(fmt.begin(), fmt.size());
-        out.write(fmt.begin(), p - fmt.begin());
-        fmt.advance_to(p + 1);
-        if(fmt.eof()) {
-            fmt.on_error("invalid format string");
+    while(detail::format_next(out, fmt)) {
+    }
+}
+
+size_t format_view::read(char* buf, size_t size) {
+    if(done_ || size == 0)
+        return 0;
+    // Output of the step that overflowed the previous chunks.
+    auto stored = (std::min)(size, pending_.size() - pending_pos_);
+    std::memcpy(buf, pending_.data() + pending_pos_, stored);
+    pending_pos_ += stored;
+    if(stored == size || consumed_) {
+        done_ = consumed_ && pending_pos_ == pending_.size();
+        return stored;
+    }
+    pending_.clear();
+    pending_pos_ = 0;
+    detail::window_context out(
+        buf + stored, size - stored, pending_, max_pending_size);
+    detail::format_parse_context fmt{format_str_, args_, last_arg_pos_};
+    for(;;) {
+        auto step_fmt = fmt;
+        out.start_step(skip_);
+        bool more = detail::format_next(out, fmt);
+        out.flush();
+        if(out.truncated()) {
+            // Run this step again once the pending output is read, past
+            // the bytes already captured.
+            skip_ += out.captured();
+            fmt = step_fmt;
             break;
         }
-        if(fmt.consume('{')) {
-            out.write('{');
-            continue;
-        }
-        unsigned arg_pos = parse_arg_ref(fmt);
-        if(fmt.fail())
-            break;
-        if(!fmt.is_char('}') && (!fmt.consume(':') || fmt.eof())) {
-            fmt.on_error("invalid format string");
+        skip_ = 0;
+        if(!more) {
+            consumed_ = true;
             break;
         }
-        const auto& arg = fmt.get_arg(arg_pos);
-        if(fmt.consume('}')) {
-            std::visit(detail::append_handler(out), arg);
-        }
-        else if(!std::holds_alternative<format_arg::handle>(arg)) {
-            detail::format_handler handler{out, fmt};
-            if(!parse_format_spec(fmt, handler.spec))
-                break;
-            std::visit(handler, arg);
-        }
-        else {
-            p = fmt.find('}');
-            if(p == nullptr) {
-                fmt.on_error("invalid format string");
-                break;
-            }
-            auto& handle = std::get<format_arg::handle>(arg);
-            parse_context arg_fmt{fmt.pos(), size_t(p - fmt.pos())};
-            fmt.advance_to(p + 1);
-            handle.format_fn(out, arg_fmt, handle.ptr);
-        }
+        if(out.full())
+            break;
     }
-    if(fmt.fail())
-        out.write(std::string_view(fmt.error()));
+    stored += out.stored();
+    format_str_ = {reinterpret_cast<const char*>(fmt.pos()), fmt.size()};
+    last_arg_pos_ = fmt.last_arg_pos();
+    done_ = consumed_ && pending_.empty();
+    return stored;
 }
 
 void vformat_to(
@@ -0,0 +1,117 @@
+#include "format_utils.hpp"
+
+#include "format_double.hpp"
+#include "format_integer.hpp"
+
+namespace univang {
+namespace fmt {
+namespace detail {
+namespace {
+
+// Rounds value / 10^digits to an integer, half to even.
+uint64_t round_half_even(uint64_t value, unsigned digits) noexcept {
+    if(digits == 0)
+        return value;
+    // Every uint64_t is below half of 10^20.
+    if(digits >= 20)
+        return 0;
+    auto divisor = zero_or_powers_of_10[digits];
+    auto quotient = value / divisor;
+    auto remainder = value % divisor;
+    auto half = divisor / 2;
+    if(remainder > half || (remainder == half && (quotient & 1) != 0))
+        ++quotient;
+    return quotient;
+}
+
+} // namespace
+
+// The mantissa, rounded to the precision, is split at the decimal point by
+// a single division; both parts come from the integer kernels, the fraction
+// zero filled to the scale, and any further precision is zero padding.
+bool do_format_decimal(
+    format_context& out, const format_spec& spec, decimal64 value) {
+    const digit_grouping* grouping = nullptr;
+    switch(spec.type) {
+    case 0:
+    case 'f':
+    case 'F':
+        break;
+    case 'n':
+        grouping = &get_digit_grouping();
+        break;
+    default:
+        return false;
+    }
+    bool negative = value.mantissa < 0;
+    uint64_t u = negative ? ~uint64_t(value.mantissa) + 1
+                          : uint64_t(value.mantissa);
+    unsigned scale = value.scale;
+    unsigned precision = spec.has_precision ? spec.precision : scale;
+    if(precision < scale) {
+        u = round_half_even(u, scale - precision);
+        scale = precision;
+    }
+    uint64_t integral = 0;
+    uint64_t fraction = u;
+    if(scale == 0) {
+        integral = u;
+        fraction = 0;
+    }
+    else if(scale < 20) {
+        integral = u / zero_or_powers_of_10[scale];
+        fraction = u % zero_or_powers_of_10[scale];
+    }
+    // At most 20 stored fraction digits, the rest are leading zeros.
+    unsigned fraction_digits = (std::min)(scale, max_fixed_digits);
+
+    char sign = negative ? '-' : (spec.sign == '-') ? 0 : spec.sign;
+    auto int_count = count_digits(integral);
+    auto int_size =
+        grouping ? grouped_size(int_count, *grouping) : int_count;
+    bool has_point = precision != 0 || spec.alt;
+    size_t size = (sign != 0) + int_size + has_point + size_t(precision);
+    size_t left_padding = 0, right_padding = 0;
+    auto fill = spec.fill ? spec.fill : ' ';
+    if(spec.width > size) {
+        auto padding = spec.width - size;
+        left_padding =
+            spec.align == '<' ? 0 : spec.align == '^' ? padding / 2 : padding;
+        right_padding = padding - left_padding;
+    }
+    write_reserved(out, size + left_padding + right_padding, [&](auto& dest) {
+        if(left_padding != 0 && spec.align != '=')
+            dest.write_padding(fill, left_padding);
+        if(sign)
+            dest.write(sign);
+        if(left_padding != 0 && spec.align == '=')
+            dest.write_padding(fill, left_padding);
+        dest.ensure(int_size + 1);
+        if(grouping) {
+            char digits[20];
+            write_dec(digits, int_count, integral);
+            dest.advance(
+                write_grouped(dest.pos(), digits, int_count, *grouping));
+        }
+        else {
+            write_dec(dest.pos(), int_count, integral);
+            dest.advance(int_count);
+        }
+        if(has_point)
+            dest.add(grouping ? grouping->decimal_point : '.');
+        dest.write_padding('0', scale - fraction_digits);
+        if(fraction_digits != 0) {
+            dest.ensure(fraction_digits);
+            write_dec_width(dest.pos(), fraction_digits, fraction);
+            dest.advance(fraction_digits);
+        }
+        dest.write_padding('0', precision - scale);
+        if(right_padding != 0)
+            dest.write_padding(fill, right_padding);
+    });
+    return true;
+}
+
+} // namespace detail
+} // namespace fmt
+} // namespace univang
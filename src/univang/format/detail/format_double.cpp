@@ -1,9 +1,21 @@
 #include "format_double.hpp"
 
 #include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "format_integer.hpp"
 
 #include <univang/format/buffer.hpp>
 
+// The shortest representation comes from Schubfach, which always succeeds;
+// define FMT_USE_GRISU=1 to use Grisu3 with the bignum fallback instead.
+#ifndef FMT_USE_GRISU
+#define FMT_USE_GRISU 0
+#endif
+
 namespace univang {
 namespace fmt {
 namespace detail {
@@ -19,6 +31,11 @@ struct double_format_options {
     int decimal_exponent_max;
     int max_precision_leading_zeros;
     int max_precision_trailing_zeros;
+    // Shortest output of non-finite values and -0.
+    const char* infinity;
+    const char* nan;
+    bool signed_infinity;
+    bool negative_zero;
 };
 
 constexpr double_format_options format_options{
@@ -27,60 +44,132 @@ constexpr double_format_options format_options{
     0,    // min_exponent_width
     -6,   // decimal_exponent_min
     21,   // decimal_exponent_max
-    6,    // max_precision_leading_zeros
-    0     // max_precision_trailing_zeros
+    6,     // max_precision_leading_zeros
+    0,     // max_precision_trailing_zeros
+    "inf", // infinity
+    "nan", // nan
+    true,  // signed_infinity
+    true   // negative_zero
+};
+
+// Number.prototype.toString(): "1e+21", "1e-7", "Infinity", "0" for -0.
+constexpr double_format_options ecmascript_options{
+    true,       // write_exponent_plus
+    0,          // zero_decimal_fraction
+    0,          // min_exponent_width
+    -6,         // decimal_exponent_min
+    20,         // decimal_exponent_max
+    6,          // max_precision_leading_zeros
+    0,          // max_precision_trailing_zeros
+    "Infinity", // infinity
+    "NaN",      // nan
+    true,       // signed_infinity
+    false       // negative_zero
+};
+
+// JSON.stringify(): ECMAScript numbers, null for non-finite values.
+constexpr double_format_options json_options{
+    true,   // write_exponent_plus
+    0,      // zero_decimal_fraction
+    0,      // min_exponent_width
+    -6,     // decimal_exponent_min
+    20,     // decimal_exponent_max
+    6,      // max_precision_leading_zeros
+    0,      // max_precision_trailing_zeros
+    "null", // infinity
+    "null", // nan
+    false,  // signed_infinity
+    false   // negative_zero
+};
+
+// Python repr(): "1.0", "1e-05", "1e+16", "-0.0".
+constexpr double_format_options python_options{
+    true,  // write_exponent_plus
+    2,     // zero_decimal_fraction
+    2,     // min_exponent_width
+    -4,    // decimal_exponent_min
+    15,    // decimal_exponent_max
+    6,     // max_precision_leading_zeros
+    0,     // max_precision_trailing_zeros
+    "inf", // infinity
+    "nan", // nan
+    true,  // signed_infinity
+    true   // negative_zero
 };
 
-unsigned exponent_format_size(const double_format_context& dbl) {
-    unsigned result = dbl.digit_count + 1;
-    if(dbl.digit_count > 1)
+template<float_style Style>
+constexpr const double_format_options& style_options() noexcept {
+    switch(Style) {
+    case float_style::ecmascript:
+        return ecmascript_options;
+    case float_style::json:
+        return json_options;
+    case float_style::python:
+        return python_options;
+    default:
+        return format_options;
+    }
+}
+
+template<const double_format_options& options, class Context>
+unsigned exponent_format_size(const Context& dbl) {
+    unsigned result = dbl.digit_count + dbl.trailing_zeros + 1;
+    if(dbl.digit_count + dbl.trailing_zeros > 1)
         ++result;
     int exponent = dbl.decimal_point - 1;
     if(exponent < 0) {
         ++result;
         exponent = -exponent;
     }
-    else if(format_options.write_exponent_plus)
-        ++result;
-    auto exponent_len = 1;
-    while(exponent > 0) {
+    else if(options.write_exponent_plus)
         ++result;
+    unsigned exponent_digits = 0;
+    do {
+        ++exponent_digits;
         exponent /= 10;
-    }
-    return result;
+    } while(exponent > 0);
+    return result + (std::max)(exponent_digits, options.min_exponent_width);
 }
 
-void format_exponent(format_context& out, const double_format_context& dbl) {
+// Writes the "e+dd" part of the exponent format.
+template<const double_format_options& options, class Out, class Context>
+void format_exponent_suffix(Out& out, const Context& dbl) {
     int exponent = dbl.decimal_point - 1;
-    assert(dbl.digit_count != 0);
-    out.add(format_context::byte(dbl.digits[0]));
-    if(dbl.digit_count != 1) {
-        out.add('.');
-        out.add(dbl.digits + 1, dbl.digit_count - 1);
-    }
-    out.add(dbl.uppercase ? 'E' : 'e');
+    out.write(dbl.uppercase ? 'E' : 'e');
     if(exponent < 0) {
-        out.add('-');
+        out.write('-');
         exponent = -exponent;
     }
-    else if(format_options.write_exponent_plus)
-        out.add('+');
-    if(exponent == 0) {
-        out.add('0');
-        return;
-    }
+    else if(options.write_exponent_plus)
+        out.write('+');
     assert(exponent < 1e4);
     constexpr unsigned max_exp_length = 5;
+    static_assert(options.min_exponent_width <= max_exp_length);
     char buffer[max_exp_length];
     unsigned pos = max_exp_length;
-    while(exponent > 0) {
+    do {
         buffer[--pos] = '0' + (exponent % 10);
         exponent /= 10;
+    } while(exponent > 0);
+    while(max_exp_length - pos < options.min_exponent_width)
+        buffer[--pos] = '0';
+    out.write(&buffer[pos], max_exp_length - pos);
+}
+
+template<const double_format_options& options, class Out, class Context>
+void format_exponent(Out& out, const Context& dbl) {
+    assert(dbl.digit_count != 0);
+    out.write(dbl.first_digit());
+    if(dbl.digit_count + dbl.trailing_zeros != 1) {
+        out.write(dbl.point());
+        out.write(dbl.digits + 1, dbl.digit_count - 1);
+        out.write_padding('0', dbl.trailing_zeros);
     }
-    out.add(&buffer[pos], max_exp_length - pos);
+    format_exponent_suffix<options>(out, dbl);
 }
 
-unsigned decimal_format_size(const double_format_context& dbl) {
+template<const double_format_options& options, class Context>
+unsigned decimal_format_size(const Context& dbl) {
     unsigned result;
     // Create a representation that is padded with zeros if needed.
     if(dbl.decimal_point <= 0)
@@ -95,67 +184,142 @@ unsigned decimal_format_size(const double_format_context& dbl) {
             - (dbl.digit_count - dbl.decimal_point);
     }
     if(dbl.digits_after_point == 0)
-        result += format_options.zero_decimal_fraction;
+        result += options.zero_decimal_fraction;
+    if(dbl.grouping && dbl.decimal_point > 0) {
+        auto count = unsigned(dbl.decimal_point);
+        result += grouped_size(count, *dbl.grouping) - count;
+    }
     return result;
 }
 
-void format_decimal(format_context& out, const double_format_context& dbl) {
+// Integral digits, padded with zeros past the stored ones.
+template<class Out, class Context>
+void format_integral(Out& out, const Context& dbl) {
+    auto count = unsigned(dbl.decimal_point);
+    auto stored = (std::min)(count, dbl.digit_count);
+    if(!dbl.grouping) {
+        out.write(dbl.digits, stored);
+        out.write_padding('0', count - stored);
+        return;
+    }
+    // 'n' is only generated in the shortest and precision modes, which keep
+    // the integral part within the digit buffer.
+    constexpr auto max_digits = Context::max_decimal_digits;
+    assert(count <= max_digits);
+    const typename Context::byte* digits = dbl.digits;
+    typename Context::byte padded[max_digits];
+    if(stored < count) {
+        std::memcpy(padded, dbl.digits, stored);
+        std::memset(padded + stored, '0', count - stored);
+        digits = padded;
+    }
+    out.ensure(grouped_size(count, *dbl.grouping));
+    out.advance(write_grouped(out.pos(), digits, count, *dbl.grouping));
+}
+
+template<const double_format_options& options, class Out, class Context>
+void format_decimal(Out& out, const Context& dbl) {
     // Create a representation that is padded with zeros if needed.
     if(dbl.decimal_point <= 0) {
         // "0.00000decimal_rep" or "0.000decimal_rep00".
-        out.add('0');
+        out.write('0');
         if(dbl.digits_after_point != 0) {
-            out.add('.');
-            out.add_padding('0', -dbl.decimal_point);
+            out.write(dbl.point());
+            out.write_padding('0', -dbl.decimal_point);
             assert(
                 dbl.digit_count
                 <= dbl.digits_after_point - (-dbl.decimal_point));
-            out.add(dbl.digits, dbl.digit_count);
+            out.write(dbl.digits, dbl.digit_count);
             auto remaining_digits = dbl.digits_after_point
                 - unsigned(-dbl.decimal_point) - dbl.digit_count;
-            out.add_padding('0', remaining_digits);
+            out.write_padding('0', remaining_digits);
         }
     }
     else if(dbl.decimal_point >= int(dbl.digit_count)) {
         // "decimal_rep0000.00000" or "decimal_rep.0000".
-        out.add(dbl.digits, dbl.digit_count);
-        out.add_padding('0', unsigned(dbl.decimal_point) - dbl.digit_count);
+        format_integral(out, dbl);
         if(dbl.digits_after_point > 0) {
-            out.add('.');
-            out.add_padding('0', dbl.digits_after_point);
+            out.write(dbl.point());
+            out.write_padding('0', dbl.digits_after_point);
         }
     }
     else {
         // "decima.l_rep000".
         assert(dbl.digits_after_point > 0);
-        out.add(dbl.digits, dbl.decimal_point);
-        out.add('.');
+        format_integral(out, dbl);
+        out.write(dbl.point());
         assert(dbl.digit_count - dbl.decimal_point <= dbl.digits_after_point);
-        out.add(
+        out.write(
             dbl.digits + dbl.decimal_point,
             dbl.digit_count - dbl.decimal_point);
         auto remaining_digits =
             dbl.digits_after_point - (dbl.digit_count - dbl.decimal_point);
-        out.add_padding('0', remaining_digits);
+        out.write_padding('0', remaining_digits);
     }
     if(dbl.digits_after_point == 0
-       && format_options.zero_decimal_fraction != 0) {
-        out.add('.');
-        if(format_options.zero_decimal_fraction > 1)
-            out.add('0');
+       && options.zero_decimal_fraction != 0) {
+        out.write(dbl.point());
+        if(options.zero_decimal_fraction > 1)
+            out.write('0');
     }
 }
 
-inline unsigned format_size(const double_format_context& dbl) {
-    return dbl.format_as_exponent ? exponent_format_size(dbl)
-                                  : decimal_format_size(dbl);
+template<const double_format_options& options, class Context>
+unsigned format_size(const Context& dbl) {
+    return dbl.format_as_exponent ? exponent_format_size<options>(dbl)
+                                  : decimal_format_size<options>(dbl);
 }
 
-inline void format(format_context& out, const double_format_context& dbl) {
+template<const double_format_options& options, class Out, class Context>
+void format(Out& out, const Context& dbl) {
     if(dbl.format_as_exponent)
-        format_exponent(out, dbl);
+        format_exponent<options>(out, dbl);
     else
-        format_decimal(out, dbl);
+        format_decimal<options>(out, dbl);
+}
+
+// Formats the shortest digits of dbl, given as an integer, straight into the
+// output: they are converted where the layout puts them, and a decimal point
+// between them is made room for by moving the fraction digits one place.
+// The output, under 32 bytes, must be ensured.
+template<const double_format_options& options, class Out>
+void format_shortest(
+    Out& out, const double_format_context& dbl, uint64_t significand) {
+    using byte = format_context::byte;
+    auto count = dbl.digit_count;
+    auto point = dbl.decimal_point;
+    auto* p = out.pos();
+    if(dbl.format_as_exponent) {
+        // The first digit moves back in front of the point.
+        write_dec(p + 1, count, significand);
+        p[0] = p[1];
+        p[1] = byte(dbl.point());
+        out.advance(count == 1 ? 1 : count + 1);
+        format_exponent_suffix<options>(out, dbl);
+        return;
+    }
+    if(point <= 0) {
+        p[0] = byte('0');
+        p[1] = byte(dbl.point());
+        std::memset(p + 2, '0', unsigned(-point));
+        write_dec(p + 2 - point, count, significand);
+        out.advance(2 - point + count);
+        return;
+    }
+    write_dec(p, count, significand);
+    if(point < int(count)) {
+        std::memmove(p + point + 1, p + point, count - point);
+        p[point] = byte(dbl.point());
+        out.advance(count + 1);
+        return;
+    }
+    std::memset(p + count, '0', point - count);
+    out.advance(point);
+    if(options.zero_decimal_fraction != 0) {
+        out.add(dbl.point());
+        if(options.zero_decimal_fraction > 1)
+            out.add('0');
+    }
 }
 
 void generate_decimal_digits(double_format_context& dbl, dtoa_mode mode) {
@@ -171,8 +335,14 @@ void generate_decimal_digits(double_format_context& dbl, dtoa_mode mode) {
     bool fast_worked = false;
     switch(mode) {
     case dtoa_mode::SHORTEST:
-        fast_worked = grisu3_dtoa(dbl);
-        break;
+#if FMT_USE_GRISU
+        if(!dbl.is_narrow()) {
+            fast_worked = grisu3_dtoa(dbl);
+            break;
+        }
+#endif
+        schubfach_dtoa(dbl);
+        return;
     case dtoa_mode::FIXED:
         fast_worked = fast_fixed_dtoa(dbl);
         break;
@@ -185,15 +355,120 @@ void generate_decimal_digits(double_format_context& dbl, dtoa_mode mode) {
     dbl.digit_count = 0;
     dbl.decimal_point = 0;
 
-    // If the fast dtoa didn't succeed use the slower bignum version.
-    bignum_dtoa(dbl, mode);
+#if FMT_USE_GRISU
+    // If Grisu3 didn't succeed use the slower bignum version.
+    if(mode == dtoa_mode::SHORTEST)
+        return bignum_dtoa(dbl, mode);
+#endif
+    exact_dtoa(dbl, mode);
+}
+
+#ifdef __SIZEOF_INT128__
+void generate_decimal_digits(wide_format_context& dbl, dtoa_mode mode) {
+    if(mode == dtoa_mode::PRECISION && dbl.requested_digits == 0)
+        return;
+
+    if(dbl.significand == 0) {
+        dbl.add_digit('0');
+        dbl.decimal_point = 1;
+        return;
+    }
+
+    // Digits past the exact expansion are zeros, which the layout pads, so
+    // the request is bounded by the digit buffer.
+    const int requested_digits = dbl.requested_digits;
+    if(mode == dtoa_mode::FIXED) {
+        dbl.requested_digits =
+            (std::min)(requested_digits, (std::max)(0, -dbl.exponent));
+    }
+    else if(mode == dtoa_mode::PRECISION) {
+        dbl.requested_digits = (std::min)(
+            requested_digits, int(wide_format_context::max_decimal_digits));
+    }
+
+    bool fast_worked = false;
+    switch(mode) {
+    case dtoa_mode::SHORTEST:
+        fast_worked = grisu3_dtoa(dbl);
+        break;
+    case dtoa_mode::FIXED:
+        break;
+    case dtoa_mode::PRECISION:
+        fast_worked = grisu3_fixed_dtoa(dbl);
+        break;
+    }
+    if(!fast_worked) {
+        dbl.digit_count = 0;
+        dbl.decimal_point = 0;
+        bignum_dtoa(dbl, mode);
+    }
+    dbl.requested_digits = requested_digits;
+}
+#endif
+
+// Shortest digits of every positive finite value of a 16-bit format, taken
+// from Schubfach when first used and looked up by the value bits, as
+// significand << 8 | exponent + 128.
+class narrow_shortest_table {
+public:
+    explicit narrow_shortest_table(const narrow_format& format)
+        : fraction_bits_(unsigned(format.significand_size - 1))
+        , min_exponent_(format.min_exponent) {
+        int bias = 1 - format.min_exponent - int(fraction_bits_);
+        auto size = size_t(2 * bias + 1) << fraction_bits_;
+        entries_.reset(new uint32_t[size]);
+        entries_[0] = 128;
+        for(size_t i = 1; i < size; ++i) {
+            auto biased_exponent = int(i >> fraction_bits_);
+            auto fraction = i & ((size_t(1) << fraction_bits_) - 1);
+            auto c = biased_exponent == 0
+                ? fraction
+                : fraction | size_t(1) << fraction_bits_;
+            auto q = (std::max)(biased_exponent, 1) - 1 + min_exponent_;
+            double_format_context dbl{std::ldexp(double(c), q)};
+            dbl.narrow(format.significand_size, format.min_exponent);
+            auto dec = schubfach_shortest(dbl);
+            entries_[i] = uint32_t(dec.significand << 8)
+                | uint32_t(dec.exponent + 128);
+        }
+    }
+
+    decimal_fp lookup(const double_format_context& dbl) const noexcept {
+        auto hidden_bit = uint64_t(1) << fraction_bits_;
+        auto biased_exponent = dbl.significand < hidden_bit
+            ? 0
+            : uint64_t(dbl.exponent - min_exponent_ + 1);
+        auto index = biased_exponent << fraction_bits_
+            | (dbl.significand & (hidden_bit - 1));
+        auto entry = entries_[index];
+        return {entry >> 8, int(entry & 0xff) - 128};
+    }
+
+private:
+    unsigned fraction_bits_;
+    int min_exponent_;
+    std::unique_ptr<uint32_t[]> entries_;
+};
+
+decimal_fp narrow_shortest(const double_format_context& dbl) {
+    if(dbl.hidden_bit
+       == uint64_t(1) << (binary16_format.significand_size - 1)) {
+        static const narrow_shortest_table table(binary16_format);
+        return table.lookup(dbl);
+    }
+    assert(
+        dbl.hidden_bit
+        == uint64_t(1) << (bfloat16_format.significand_size - 1));
+    static const narrow_shortest_table table(bfloat16_format);
+    return table.lookup(dbl);
 }
 
-void generate_shortest(double_format_context& dbl) {
-    generate_decimal_digits(dbl, dtoa_mode::SHORTEST);
+// Chooses between the decimal and the exponent format of shortest digits.
+template<const double_format_options& options, class Context>
+void shortest_layout(Context& dbl) {
     int exponent = dbl.decimal_point - 1;
-    if(format_options.decimal_exponent_min <= exponent
-       && exponent <= format_options.decimal_exponent_max) {
+    if(options.decimal_exponent_min <= exponent
+       && exponent <= options.decimal_exponent_max) {
         dbl.digits_after_point =
             (std::max)(0, int(dbl.digit_count) - dbl.decimal_point);
     }
@@ -202,31 +477,55 @@ void generate_shortest(double_format_context& dbl) {
     }
 }
 
-bool generate_fixed(double_format_context& dbl) {
-    const double max_fixed_value = 1e60;
-    if(dbl.value >= max_fixed_value || dbl.value <= -max_fixed_value)
-        return false;
-    dbl.requested_digits = std::clamp(dbl.requested_digits, 0, 60);
+// Returns true if the digits are left in significand for format_shortest
+// rather than in the digit buffer, which grouping and Grisu need.
+template<const double_format_options& options>
+bool generate_shortest(double_format_context& dbl, uint64_t& significand) {
+    const bool direct = !dbl.grouping && (!FMT_USE_GRISU || dbl.is_narrow());
+    if(direct) {
+        auto dec = dbl.value == 0 ? decimal_fp{0, 0}
+            : dbl.is_narrow()     ? narrow_shortest(dbl)
+                                  : schubfach_shortest(dbl);
+        significand = dec.significand;
+        dbl.digit_count = count_digits(dec.significand);
+        dbl.decimal_point = int(dbl.digit_count) + dec.exponent;
+    }
+    else
+        generate_decimal_digits(dbl, dtoa_mode::SHORTEST);
+    shortest_layout<options>(dbl);
+    return direct;
+}
+
+template<class Context>
+void generate_fixed(Context& dbl) {
+    dbl.requested_digits = (std::max)(dbl.requested_digits, 0);
     generate_decimal_digits(dbl, dtoa_mode::FIXED);
     dbl.digits_after_point = dbl.requested_digits;
-    return true;
 }
 
-void generate_exponent(double_format_context& dbl) {
-    dbl.requested_digits = std::clamp(dbl.requested_digits, 0, 120);
+// Pads the stored digits to the requested count in the exponent format.
+template<class Context>
+void pad_exponent_digits(Context& dbl) {
+    if(dbl.digit_count < unsigned(dbl.requested_digits))
+        dbl.trailing_zeros = unsigned(dbl.requested_digits) - dbl.digit_count;
+    dbl.format_as_exponent = true;
+}
+
+template<class Context>
+void generate_exponent(Context& dbl) {
+    dbl.requested_digits = (std::max)(dbl.requested_digits, 0);
     if(!dbl.has_requested_digits)
         generate_decimal_digits(dbl, dtoa_mode::SHORTEST);
     else {
         ++dbl.requested_digits;
         generate_decimal_digits(dbl, dtoa_mode::PRECISION);
-        while(dbl.digit_count < unsigned(dbl.requested_digits))
-            dbl.add_digit('0');
     }
-    dbl.format_as_exponent = true;
+    pad_exponent_digits(dbl);
 }
 
-void generate_precision(double_format_context& dbl) {
-    dbl.requested_digits = std::clamp(dbl.requested_digits, 1, 120);
+template<class Context>
+void generate_precision(Context& dbl) {
+    dbl.requested_digits = (std::max)(dbl.requested_digits, 1);
 
     generate_decimal_digits(dbl, dtoa_mode::PRECISION);
     assert(dbl.digit_count <= unsigned(dbl.requested_digits));
@@ -236,9 +535,7 @@ void generate_precision(double_format_context& dbl) {
     if((-dbl.decimal_point + 1 > format_options.max_precision_leading_zeros)
        || (dbl.decimal_point - dbl.requested_digits + extra_zero
            > format_options.max_precision_trailing_zeros)) {
-        while(dbl.digit_count < unsigned(dbl.requested_digits))
-            dbl.add_digit('0');
-        dbl.format_as_exponent = true;
+        pad_exponent_digits(dbl);
     }
     else {
         dbl.digits_after_point =
@@ -246,6 +543,77 @@ void generate_precision(double_format_context& dbl) {
     }
 }
 
+// Digits and layout of the types other than the shortest output.
+template<class Context>
+void generate(Context& dbl, const format_spec& spec) {
+    switch(spec.type) {
+    case 'E':
+    case 'e':
+        generate_exponent(dbl);
+        break;
+    case 'F':
+    case 'f':
+        generate_fixed(dbl);
+        break;
+    default:
+        generate_precision(dbl);
+        break;
+    }
+}
+
+// True if the type takes the shortest digits and their layout.
+bool is_shortest(const format_spec& spec) noexcept {
+    switch(spec.type) {
+    case 0:
+    case 'G':
+    case 'g':
+    case 'n':
+    case '%':
+        return !spec.has_precision;
+    default:
+        return false;
+    }
+}
+
+// Writes the size bytes of formatted digits by body, with the sign, the
+// padding and the '%' suffix of spec.
+template<class Body>
+void write_float(
+    format_context& out, const format_spec& spec, unsigned size,
+    Body&& body) {
+    if(spec.sign)
+        ++size;
+    if(spec.type == '%')
+        ++size;
+    unsigned left_padding = 0, right_padding = 0;
+    auto fill = spec.fill ? spec.fill : ' ';
+    if(spec.width > size) {
+        auto padding = spec.width - size;
+        left_padding =
+            spec.align == '<' ? 0 : spec.align == '^' ? padding / 2 : padding;
+        right_padding = spec.align == '<'
+            ? padding
+            : spec.align == '^' ? padding - left_padding : 0;
+    }
+    auto padding = left_padding + right_padding;
+    write_reserved(out, size + padding, [&](auto& dest) {
+        if(left_padding != 0 && spec.align != '=')
+            dest.write_padding(fill, left_padding);
+        dest.ensure(size);
+        if(spec.sign)
+            dest.add(spec.sign);
+        if(left_padding != 0 && spec.align == '=') {
+            dest.write_padding(fill, left_padding);
+            dest.ensure(size);
+        }
+        body(dest);
+        if(spec.type == '%')
+            dest.add('%');
+        if(right_padding != 0)
+            dest.write_padding(fill, right_padding);
+    });
+}
+
 void format_nan_inf(format_context& out, const format_spec& spec, bool inf) {
     char buf[5];
     size_t width = 0;
@@ -258,10 +626,121 @@ void format_nan_inf(format_context& out, const format_spec& spec, bool inf) {
     write_padded(out, spec, padded_string({buf, width}));
 }
 
+// Writes the low len hex digits of value.
+template<class Char, class Significand>
+void write_hex_digits(
+    Char* out, unsigned len, Significand value, bool upper) noexcept {
+    if constexpr(sizeof(Significand) > sizeof(uint64_t)) {
+        if(len > 16) {
+            write_hex(out, len - 16, uint64_t(value >> 64), upper);
+            out += len - 16;
+            len = 16;
+        }
+    }
+    write_hex(out, len, uint64_t(value), upper);
+}
+
+// Hexadecimal format of a finite non-negative value, as printf("%a"): the
+// leading digit is taken from the bits of significand above fraction_bits,
+// a multiple of 4, and exponent is that of its lowest bit.
+// A precision below the fraction digits rounds half to even, which can
+// carry into the leading digit.
+template<class Significand>
+void format_hex(
+    format_context& out, const format_spec& spec, Significand significand,
+    unsigned fraction_bits, int exponent) {
+    const unsigned fraction_digits = fraction_bits / 4;
+    const Significand one = 1;
+    Significand fraction = significand & ((one << fraction_bits) - 1);
+    unsigned leading = unsigned(significand >> fraction_bits);
+    unsigned digits = fraction_digits;
+    if(!spec.has_precision) {
+        for(; digits != 0 && (fraction & 0xf) == 0; --digits)
+            fraction >>= 4;
+    }
+    else if(spec.precision < fraction_digits) {
+        digits = spec.precision;
+        auto shift = (fraction_digits - digits) * 4;
+        auto rest = fraction & ((one << shift) - 1);
+        auto half = one << (shift - 1);
+        auto kept = significand >> shift;
+        if(rest > half || (rest == half && (kept & 1) != 0))
+            ++kept;
+        leading = unsigned(kept >> (digits * 4));
+        fraction = kept & ((one << (digits * 4)) - 1);
+    }
+    unsigned trailing_zeros =
+        spec.has_precision && spec.precision > digits ? spec.precision - digits
+                                                      : 0;
+    bool upper = spec.type == 'A';
+    bool point = digits + trailing_zeros != 0 || spec.alt;
+    unsigned abs_exponent = unsigned(exponent < 0 ? -exponent : exponent);
+    auto exponent_digits = count_digits(abs_exponent);
+    // Leading digit [point] digits 'p' sign exponent, after the "0x".
+    size_t size = 1 + point + digits + 2 + exponent_digits;
+    size_t body_size = 2 + size + trailing_zeros;
+    if(spec.sign)
+        ++body_size;
+    size_t left_padding = 0, right_padding = 0;
+    auto fill = spec.fill ? spec.fill : ' ';
+    if(spec.width > body_size) {
+        auto padding = spec.width - body_size;
+        left_padding =
+            spec.align == '<' ? 0 : spec.align == '^' ? padding / 2 : padding;
+        right_padding = padding - left_padding;
+    }
+    write_reserved(
+        out, body_size + left_padding + right_padding, [&](auto& dest) {
+            if(left_padding != 0 && spec.align != '=')
+                dest.write_padding(fill, left_padding);
+            dest.ensure(3);
+            if(spec.sign)
+                dest.add(spec.sign);
+            dest.add('0');
+            dest.add(upper ? 'X' : 'x');
+            if(left_padding != 0 && spec.align == '=')
+                dest.write_padding(fill, left_padding);
+            dest.ensure(size);
+            dest.add(char('0' + leading));
+            if(point)
+                dest.add('.');
+            write_hex_digits(dest.pos(), digits, fraction, upper);
+            dest.advance(digits);
+            dest.write_padding('0', trailing_zeros);
+            dest.ensure(2 + exponent_digits);
+            dest.add(upper ? 'P' : 'p');
+            dest.add(exponent < 0 ? '-' : '+');
+            write_dec(dest.pos(), exponent_digits, abs_exponent);
+            dest.advance(exponent_digits);
+            if(right_padding != 0)
+                dest.write_padding(fill, right_padding);
+        });
+}
+
+// The leading digit is the hidden bit, so subnormals print as
+// 0x0.xxxp-1022.
+void format_hex(format_context& out, const format_spec& spec, double value) {
+    auto u = bit_cast<uint64_t>(value);
+    uint64_t significand = u & Double::kSignificandMask;
+    uint64_t exponent_bits = u & Double::kExponentMask;
+    int exponent = 0;
+    if(exponent_bits != 0) {
+        significand += Double::kHiddenBit;
+        exponent = int(exponent_bits >> Double::kPhysicalSignificandSize)
+            - Double::kExponentBias + Double::kPhysicalSignificandSize;
+    }
+    else if(significand != 0)
+        exponent = Double::kDenormalExponent + Double::kPhysicalSignificandSize;
+    format_hex(
+        out, spec, significand, Double::kPhysicalSignificandSize, exponent);
+}
+
 } // namespace
 
 // Floating point format.
-void do_format_double(format_context& out, format_spec& spec, double value) {
+void do_format_double(
+    format_context& out, format_spec& spec, double value,
+    const narrow_format* narrow) {
     bool negative = std::signbit(value);
     if(negative)
         value = -value;
@@ -270,6 +749,9 @@ void do_format_double(format_context& out, format_spec& spec, double value) {
     if(!std::isfinite(value))
         return format_nan_inf(out, spec, std::isinf(value));
 
+    if(spec.type == 'a' || spec.type == 'A')
+        return format_hex(out, spec, value);
+
     if(spec.type == '%')
         value *= 100;
 
@@ -277,54 +759,366 @@ void do_format_double(format_context& out, format_spec& spec, double value) {
     dbl.uppercase = spec.type != 0 && spec.type < 'a';
     dbl.has_requested_digits = spec.has_precision;
     dbl.requested_digits = spec.has_precision ? spec.precision : 6;
+    if(spec.type == 'n')
+        dbl.grouping = &get_digit_grouping();
+    if(narrow && !spec.has_precision && spec.type != 'f' && spec.type != 'F'
+       && spec.type != '%')
+        dbl.narrow(narrow->significand_size, narrow->min_exponent);
+    uint64_t significand = 0;
+    bool direct = false;
+    if(is_shortest(spec))
+        direct = generate_shortest<format_options>(dbl, significand);
+    else
+        generate(dbl, spec);
 
-    switch(spec.type) {
-    case 'E':
-    case 'e':
-        generate_exponent(dbl);
-        break;
-    case 'F':
-    case 'f':
-        if(!generate_fixed(dbl))
-            generate_precision(dbl);
-        break;
-    case 0:
-    case 'G':
-    case 'g':
-    case '%':
-        if(spec.has_precision)
-            generate_precision(dbl);
+    write_float(out, spec, format_size<format_options>(dbl), [&](auto& dest) {
+        if(direct)
+            format_shortest<format_options>(dest, dbl, significand);
         else
-            generate_shortest(dbl);
-        break;
+            format<format_options>(dest, dbl);
+    });
+}
+
+namespace {
+
+#ifdef __SIZEOF_INT128__
+// Sign, class and value significand * 2^exponent of a format wider than
+// double.
+struct wide_fields {
+    uint128_t significand;
+    int exponent;
+    bool negative;
+    bool inf;
+    bool nan;
+};
+
+constexpr int wide_exponent_bias = 16383;
+constexpr int x87_significand_size = 64;
+constexpr int binary128_significand_size = 113;
+
+// x87 extended precision: a 64-bit significand with an explicit integer bit,
+// then the 15-bit exponent and the sign.
+wide_fields decode_x87(const void* value) noexcept {
+    uint64_t significand;
+    uint16_t top;
+    std::memcpy(&significand, value, sizeof(significand));
+    std::memcpy(
+        &top, static_cast<const char*>(value) + sizeof(significand),
+        sizeof(top));
+    wide_fields result{significand, 0, (top >> 15) != 0, false, false};
+    int biased_exponent = top & 0x7fff;
+    bool integer_bit = (significand >> 63) != 0;
+    if(biased_exponent == 0x7fff) {
+        result.inf = significand == uint64_t(1) << 63;
+        result.nan = !result.inf;
+    }
+    // Unnormals are invalid operands, printf shows them as nan.
+    else if(biased_exponent != 0 && !integer_bit)
+        result.nan = true;
+    else {
+        result.exponent = (std::max)(biased_exponent, 1)
+            - wide_exponent_bias - (x87_significand_size - 1);
     }
+    return result;
+}
 
-    auto size = format_size(dbl);
-    if(spec.sign)
-        ++size;
-    if(spec.type == '%')
-        ++size;
-    unsigned left_padding = 0, right_padding = 0;
-    auto fill = spec.fill ? spec.fill : ' ';
-    if(spec.width > size) {
-        size = spec.width;
-        auto padding = spec.width - unsigned(size);
-        left_padding =
-            spec.align == '<' ? 0 : spec.align == '^' ? padding / 2 : padding;
-        auto right_padding = spec.align == '<'
-            ? padding
-            : spec.align == '^' ? padding - left_padding : 0;
+// IEEE binary128: a 112-bit fraction with a hidden bit, then the 15-bit
+// exponent and the sign.
+wide_fields decode_binary128(const void* value) noexcept {
+    uint64_t halves[2];
+    std::memcpy(halves, value, sizeof(halves));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint64_t lo = halves[1], hi = halves[0];
+#else
+    uint64_t lo = halves[0], hi = halves[1];
+#endif
+    constexpr int fraction_bits = binary128_significand_size - 1;
+    auto fraction = uint128_t(hi & 0xffffffffffffull) << 64 | lo;
+    wide_fields result{fraction, 0, (hi >> 63) != 0, false, false};
+    int biased_exponent = int(hi >> 48) & 0x7fff;
+    if(biased_exponent == 0x7fff) {
+        result.inf = fraction == 0;
+        result.nan = !result.inf;
+        return result;
     }
-    out.ensure(size);
-    if(left_padding != 0)
-        out.add_padding(fill, left_padding);
-    if(spec.sign)
-        out.add(spec.sign);
-    format(out, dbl);
+    if(biased_exponent != 0)
+        result.significand |= uint128_t(1) << fraction_bits;
+    result.exponent =
+        (std::max)(biased_exponent, 1) - wide_exponent_bias - fraction_bits;
+    return result;
+}
+
+// Normalized hexadecimal format: "0x1.xxxp+e" for every non-zero value.
+void format_wide_hex(
+    format_context& out, const format_spec& spec, const wide_fields& value,
+    int significand_size) {
+    // Fraction bits in whole hex digits.
+    const unsigned fraction_bits = unsigned(significand_size - 1 + 3) / 4 * 4;
+    auto significand = value.significand;
+    int exponent = 0;
+    if(significand != 0) {
+        auto hidden_bit = uint128_t(1) << (significand_size - 1);
+        exponent = value.exponent + significand_size - 1;
+        for(; significand < hidden_bit; --exponent)
+            significand <<= 1;
+        significand <<= fraction_bits - unsigned(significand_size - 1);
+    }
+    format_hex(out, spec, significand, fraction_bits, exponent);
+}
+
+void format_wide(
+    format_context& out, format_spec& spec, const wide_fields& value,
+    int significand_size) {
+    spec.sign = value.negative ? '-' : (spec.sign == '-') ? 0 : spec.sign;
+
+    if(value.inf || value.nan)
+        return format_nan_inf(out, spec, value.inf);
+
+    if(spec.type == 'a' || spec.type == 'A')
+        return format_wide_hex(out, spec, value, significand_size);
+
+    wide_format_context dbl{
+        value.significand, value.exponent, significand_size,
+        1 - wide_exponent_bias - (significand_size - 1)};
+    dbl.uppercase = spec.type != 0 && spec.type < 'a';
+    dbl.has_requested_digits = spec.has_precision;
+    dbl.requested_digits = spec.has_precision ? spec.precision : 6;
+    if(spec.type == 'n')
+        dbl.grouping = &get_digit_grouping();
+    if(is_shortest(spec)) {
+        generate_decimal_digits(dbl, dtoa_mode::SHORTEST);
+        shortest_layout<format_options>(dbl);
+    }
+    else
+        generate(dbl, spec);
+
+    write_float(out, spec, format_size<format_options>(dbl), [&](auto& dest) {
+        format<format_options>(dest, dbl);
+    });
+}
+#endif
+
+} // namespace
+
+void do_format_long_double(
+    format_context& out, format_spec& spec, long double value) {
+#if defined(__SIZEOF_INT128__) && (LDBL_MANT_DIG == 64 || LDBL_MANT_DIG == 113)
     if(spec.type == '%')
-        out.add('%');
-    if(right_padding != 0)
-        out.add_padding(fill, right_padding);
+        value *= 100;
+#if LDBL_MANT_DIG == 64
+    format_wide(out, spec, decode_x87(&value), x87_significand_size);
+#else
+    format_wide(
+        out, spec, decode_binary128(&value), binary128_significand_size);
+#endif
+#else
+    // long double is double, a double-double or has no decoder.
+    do_format_double(out, spec, double(value));
+#endif
+}
+
+#ifdef __SIZEOF_FLOAT128__
+void do_format_float128(
+    format_context& out, format_spec& spec, __float128 value) {
+#ifdef __SIZEOF_INT128__
+    if(spec.type == '%')
+        value *= 100;
+    format_wide(
+        out, spec, decode_binary128(&value), binary128_significand_size);
+#else
+    do_format_long_double(out, spec, static_cast<long double>(value));
+#endif
+}
+#endif
+
+template<float_style Style>
+void append_double(format_context& out, double value) {
+    constexpr const auto& options = style_options<Style>();
+    bool negative = std::signbit(value);
+    if(!std::isfinite(value)) {
+        bool inf = std::isinf(value);
+        if(inf && negative && options.signed_infinity)
+            out.write('-');
+        out.write(std::string_view(inf ? options.infinity : options.nan));
+        return;
+    }
+    if(value == 0 && !options.negative_zero)
+        negative = false;
+    double_format_context dbl{std::fabs(value)};
+    uint64_t significand = 0;
+    bool direct = generate_shortest<options>(dbl, significand);
+    auto size = format_size<options>(dbl) + (negative ? 1 : 0);
+    write_reserved(out, size, [&](auto& dest) {
+        dest.ensure(size);
+        if(negative)
+            dest.add('-');
+        if(direct)
+            format_shortest<options>(dest, dbl, significand);
+        else
+            format<options>(dest, dbl);
+    });
+}
+
+template void append_double<float_style::standard>(format_context&, double);
+template void append_double<float_style::ecmascript>(
+    format_context&, double);
+template void append_double<float_style::json>(format_context&, double);
+template void append_double<float_style::python>(format_context&, double);
+
+namespace {
+
+// Layout of one element of a format_doubles() block.
+struct shortest_item {
+    uint64_t significand;
+    int decimal_point;
+    unsigned digit_count;
+    unsigned digits_after_point;
+    unsigned size;
+    char sign;
+    // 'e' for the exponent format, 'i' and 'n' for inf and nan.
+    char layout;
+};
+
+// Elements converted before their output is written. Big enough to keep
+// the separators and the per block reservation cheap, small enough for the
+// block to stay in L1.
+constexpr size_t shortest_block_size = 64;
+
+// True if every element takes the format_shortest() path of
+// do_format_double() with no padding.
+bool is_plain_shortest(
+    const format_spec& spec, const narrow_format* narrow) noexcept {
+    return (!FMT_USE_GRISU || narrow) && !spec.has_precision
+        && spec.width == 0
+        && (spec.type == 0 || spec.type == 'g' || spec.type == 'G');
+}
+
+inline double widen(double value) noexcept {
+    return value;
+}
+inline double widen(float16 value) noexcept {
+    return value.to_double();
+}
+inline double widen(bfloat16 value) noexcept {
+    return value.to_double();
+}
+
+// Reuses dbl for the binary fields and the layout of every element rather
+// than constructing a context per value.
+template<class T>
+void convert_block(
+    shortest_item* items, double_format_context& dbl, const T* values,
+    size_t count, const format_spec& spec,
+    const narrow_format* narrow) noexcept {
+    for(size_t i = 0; i < count; ++i) {
+        auto value = widen(values[i]);
+        auto& item = items[i];
+        bool negative = std::signbit(value);
+        item.sign = negative ? '-' : (spec.sign == '-') ? 0 : spec.sign;
+        if(!std::isfinite(value)) {
+            item.layout = std::isinf(value) ? 'i' : 'n';
+            if(item.layout == 'n')
+                item.sign = 0;
+            item.size = item.sign ? 4 : 3;
+            continue;
+        }
+        dbl.assign(negative ? -value : value);
+        dbl.format_as_exponent = false;
+        dbl.digits_after_point = 0;
+        if(narrow)
+            dbl.narrow(narrow->significand_size, narrow->min_exponent);
+        generate_shortest<format_options>(dbl, item.significand);
+        item.decimal_point = dbl.decimal_point;
+        item.digit_count = dbl.digit_count;
+        item.digits_after_point = dbl.digits_after_point;
+        item.layout = dbl.format_as_exponent ? 'e' : 0;
+        item.size = format_size<format_options>(dbl) + (item.sign ? 1 : 0);
+    }
+}
+
+template<class Out>
+void write_block(
+    Out& out, double_format_context& dbl, const shortest_item* items,
+    size_t count, std::string_view sep) {
+    for(size_t i = 0; i < count; ++i) {
+        const auto& item = items[i];
+        if(i != 0)
+            out.write(sep);
+        out.ensure(item.size);
+        if(item.sign)
+            out.add(item.sign);
+        if(item.layout == 'i' || item.layout == 'n') {
+            const char* str = item.layout == 'i'
+                ? (dbl.uppercase ? "INF" : "inf")
+                : (dbl.uppercase ? "NAN" : "nan");
+            out.write(str, 3);
+            continue;
+        }
+        dbl.decimal_point = item.decimal_point;
+        dbl.digit_count = item.digit_count;
+        dbl.digits_after_point = item.digits_after_point;
+        dbl.format_as_exponent = item.layout == 'e';
+        format_shortest<format_options>(out, dbl, item.significand);
+    }
+}
+
+// The spec is validated and resolved once. Plain shortest output is
+// converted a block at a time into compact layouts, so the conversions of
+// independent elements overlap, and then written through one reservation
+// per block; any other spec formats each element by do_format_double().
+template<class T>
+void format_floats(
+    format_context& out, const T* values, size_t count,
+    const format_spec& spec, std::string_view sep,
+    const narrow_format* narrow) {
+    if(!validate_float_spec(spec))
+        throw std::invalid_argument("invalid floating type");
+    if(!is_plain_shortest(spec, narrow)) {
+        for(size_t i = 0; i < count; ++i) {
+            if(i != 0)
+                out.write(sep);
+            auto element_spec = spec;
+            do_format_double(out, element_spec, widen(values[i]), narrow);
+        }
+        return;
+    }
+    shortest_item items[shortest_block_size];
+    double_format_context dbl{0.0};
+    dbl.uppercase = spec.type == 'G';
+    for(size_t first = 0; first < count; first += shortest_block_size) {
+        auto block = (std::min)(count - first, shortest_block_size);
+        convert_block(items, dbl, values + first, block, spec, narrow);
+        auto size = (block - 1) * sep.size();
+        for(size_t i = 0; i < block; ++i)
+            size += items[i].size;
+        if(first != 0)
+            out.write(sep);
+        if(out.capacity() - out.size() < size)
+            out.reserve(out.size() + size);
+        write_reserved(out, size, [&](auto& dest) {
+            write_block(dest, dbl, items, block, sep);
+        });
+    }
+}
+
+} // namespace
+
+void format_doubles(
+    format_context& out, const double* values, size_t count,
+    const format_spec& spec, std::string_view sep) {
+    format_floats(out, values, count, spec, sep, nullptr);
+}
+
+void format_doubles(
+    format_context& out, const float16* values, size_t count,
+    const format_spec& spec, std::string_view sep) {
+    format_floats(out, values, count, spec, sep, &binary16_format);
+}
+
+void format_doubles(
+    format_context& out, const bfloat16* values, size_t count,
+    const format_spec& spec, std::string_view sep) {
+    format_floats(out, values, count, spec, sep, &bfloat16_format);
 }
 
 } // namespace detail
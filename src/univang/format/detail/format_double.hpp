@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
 
 #include "format_utils.hpp"
@@ -10,12 +11,15 @@ namespace detail {
 constexpr bool validate_float_spec(const format_spec& spec) {
     switch(spec.type) {
     case 0:
+    case 'A':
+    case 'a':
     case 'E':
     case 'e':
     case 'F':
     case 'f':
     case 'G':
     case 'g':
+    case 'n':
     case '%':
         return true;
     default:
@@ -34,33 +38,14 @@ constexpr const int kExponentBias = 0x3FF + kPhysicalSignificandSize;
 constexpr const int kDenormalExponent = -kExponentBias + 1;
 } // namespace Double
 
-struct double_format_context {
+// Decimal digits of a binary floating point value and their layout, shared by
+// double and the formats wider than double.
+template<size_t MaxDigits>
+struct float_digits {
     enum class byte : char {}; // To avoid misaliasing.
 
-    constexpr const static size_t max_decimal_digits = 128;
+    constexpr const static size_t max_decimal_digits = MaxDigits;
 
-    double_format_context(double value) : value(value) {
-        auto u = bit_cast<uint64_t>(value);
-        uint64_t significand = u & Double::kSignificandMask;
-        uint64_t exponent_bits = u & Double::kExponentMask;
-        int exponent;
-        if(exponent_bits != 0) {
-            significand += Double::kHiddenBit;
-            exponent = int(exponent_bits >> Double::kPhysicalSignificandSize)
-                - Double::kExponentBias;
-        }
-        // Denormal
-        else {
-            exponent = Double::kDenormalExponent;
-        }
-        this->significand = significand;
-        this->exponent = exponent;
-    }
-
-    // Formatted value.
-    double value;
-    uint64_t significand;
-    int exponent;
     bool uppercase = false;
     bool has_requested_digits = false;
     bool format_as_exponent = false;
@@ -68,12 +53,16 @@ struct double_format_context {
     int requested_digits = 0;
     int decimal_point = 0;
     unsigned digit_count = 0;
+    // Zeros past the stored digits in the exponent format.
+    unsigned trailing_zeros = 0;
+    // Grouping of the integral digits for the 'n' type.
+    const digit_grouping* grouping = nullptr;
 
     // Decimal digits representation.
     byte digits[max_decimal_digits];
 
-    bool lower_boundary_is_closer() const {
-        return significand == Double::kHiddenBit;
+    char point() const noexcept {
+        return grouping ? grouping->decimal_point : '.';
     }
     char digit(unsigned pos) const noexcept {
         assert(pos < digit_count);
@@ -107,7 +96,6 @@ struct double_format_context {
     }
     void round_down_digit(unsigned pos) {
         assert(pos < digit_count);
-        auto u = uint8_t(digits[pos]);
         digits[pos] = byte(uint8_t(digits[pos]) - 1);
     }
     void round_down_last_digit() {
@@ -116,7 +104,6 @@ struct double_format_context {
     }
     void round_up_digit(unsigned pos) {
         assert(pos < digit_count);
-        auto u = uint8_t(digits[pos]);
         digits[pos] = byte(uint8_t(digits[pos]) + 1);
     }
     void round_up_last_digit() {
@@ -147,15 +134,159 @@ struct double_format_context {
     }
 };
 
+// A double has at most 767 significant digits; exact_dtoa stores them in
+// chunks of nine.
+struct double_format_context : float_digits<800> {
+    using significand_type = uint64_t;
+
+    double_format_context(double value) {
+        assign(value);
+    }
+
+    // Decodes another value into the binary fields, so that one context
+    // can convert a sequence of values. The decimal fields are left as is.
+    void assign(double value) noexcept {
+        this->value = value;
+        hidden_bit = Double::kHiddenBit;
+        min_exponent = Double::kDenormalExponent;
+        auto u = bit_cast<uint64_t>(value);
+        uint64_t significand = u & Double::kSignificandMask;
+        uint64_t exponent_bits = u & Double::kExponentMask;
+        int exponent;
+        if(exponent_bits != 0) {
+            significand += Double::kHiddenBit;
+            exponent = int(exponent_bits >> Double::kPhysicalSignificandSize)
+                - Double::kExponentBias;
+        }
+        // Denormal
+        else {
+            exponent = Double::kDenormalExponent;
+        }
+        this->significand = significand;
+        this->exponent = exponent;
+    }
+
+    // Formatted value.
+    double value;
+    uint64_t significand;
+    int exponent;
+    // Format whose rounding interval the shortest digits are taken from.
+    uint64_t hidden_bit = Double::kHiddenBit;
+    int min_exponent = Double::kDenormalExponent;
+
+    bool lower_boundary_is_closer() const {
+        return significand == hidden_bit;
+    }
+    bool is_narrow() const noexcept {
+        return hidden_bit != Double::kHiddenBit;
+    }
+    // Re-expresses the value, which must be exact in a binary format with
+    // significand_size bits and subnormals at 2^min_exponent, in that format,
+    // so that the shortest digits round trip to it rather than to double.
+    void narrow(int significand_size, int min_exponent) noexcept {
+        hidden_bit = uint64_t(1) << (significand_size - 1);
+        this->min_exponent = min_exponent;
+        if(significand == 0)
+            return;
+        auto e = (std::max)(
+            exponent + Double::kSignificandSize - significand_size,
+            min_exponent);
+        assert((significand & ((uint64_t(1) << (e - exponent)) - 1)) == 0);
+        significand >>= e - exponent;
+        exponent = e;
+    }
+};
+
 enum class dtoa_mode { SHORTEST, FIXED, PRECISION };
 
+// significand * 10^exponent with the fewest significand digits.
+struct decimal_fp {
+    uint64_t significand;
+    int exponent;
+};
+
+decimal_fp schubfach_shortest(const double_format_context& dbl) noexcept;
+void schubfach_dtoa(double_format_context& dbl);
 bool grisu3_dtoa(double_format_context& dbl);
 bool grisu3_fixed_dtoa(double_format_context& dbl);
 bool fast_fixed_dtoa(double_format_context& out);
 void bignum_dtoa(double_format_context& dbl, dtoa_mode mode);
+void exact_dtoa(double_format_context& dbl, dtoa_mode mode);
+
+#ifdef __SIZEOF_INT128__
+using uint128_t = unsigned __int128;
+
+// Value significand * 2^exponent of a binary format wider than double: x87
+// extended precision or IEEE binary128. The smallest binary128 subnormal has
+// 11564 significant digits.
+struct wide_format_context : float_digits<11600> {
+    using significand_type = uint128_t;
+
+    wide_format_context(
+        uint128_t significand, int exponent, int significand_size,
+        int min_exponent) noexcept
+        : significand(significand)
+        , exponent(exponent)
+        , hidden_bit(uint128_t(1) << (significand_size - 1))
+        , min_exponent(min_exponent)
+        , significand_size(significand_size) {
+    }
+
+    uint128_t significand;
+    int exponent;
+    uint128_t hidden_bit;
+    int min_exponent;
+    int significand_size;
+
+    bool lower_boundary_is_closer() const noexcept {
+        return significand == hidden_bit && exponent > min_exponent;
+    }
+};
+
+// Grisu3 on a 128-bit DiyFp, falling back to the bignum digits.
+bool grisu3_dtoa(wide_format_context& dbl);
+bool grisu3_fixed_dtoa(wide_format_context& dbl);
+void bignum_dtoa(wide_format_context& dbl, dtoa_mode mode);
+#endif
+
+// Binary format narrower than double, see double_format_context::narrow().
+struct narrow_format {
+    int significand_size;
+    int min_exponent;
+};
+constexpr narrow_format binary16_format{11, -24};
+constexpr narrow_format bfloat16_format{8, -133};
+
+// Floating point format. Shortest digits of a value converted from a
+// narrow format are those of that format.
+void do_format_double(
+    format_context& out, format_spec& spec, double value,
+    const narrow_format* narrow = nullptr);
+
+// Exact where a 128-bit integer type is available; otherwise long double
+// is formatted as double and __float128 as long double.
+void do_format_long_double(
+    format_context& out, format_spec& spec, long double value);
+#ifdef __SIZEOF_FLOAT128__
+void do_format_float128(
+    format_context& out, format_spec& spec, __float128 value);
+#endif
+
+// Fixed point decimal format. Returns false for a type other than f, F and
+// n.
+bool do_format_decimal(
+    format_context& out, const format_spec& spec, decimal64 value);
 
-// Floating point format.
-void do_format_double(format_context& out, format_spec& spec, double value);
+// Formats count values with the same spec, joined by sep.
+void format_doubles(
+    format_context& out, const double* values, size_t count,
+    const format_spec& spec, std::string_view sep);
+void format_doubles(
+    format_context& out, const float16* values, size_t count,
+    const format_spec& spec, std::string_view sep);
+void format_doubles(
+    format_context& out, const bfloat16* values, size_t count,
+    const format_spec& spec, std::string_view sep);
 
 } // namespace detail
 } // namespace fmt
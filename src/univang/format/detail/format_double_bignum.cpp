@@ -36,11 +36,12 @@ namespace detail {
 
 namespace {
 
-using byte = double_format_context::byte;
-
-int NormalizedExponent(uint64_t significand, int exponent) {
+template<class Significand>
+int NormalizedExponent(
+    Significand significand, int exponent, int significand_size) {
     assert(significand != 0);
-    while((significand & Double::kHiddenBit) == 0) {
+    const auto hidden_bit = Significand(1) << (significand_size - 1);
+    while((significand & hidden_bit) == 0) {
         significand = significand << 1;
         exponent = exponent - 1;
     }
@@ -49,10 +50,10 @@ int NormalizedExponent(uint64_t significand, int exponent) {
 
 class Bignum {
 public:
-    // 3584 = 128 * 28. We can represent 2^3584 > 10^1000 accurately.
-    // This bignum can encode much bigger numbers, since it contains an
-    // exponent.
-    static const int kMaxSignificantBits = 3584;
+    // 20480 = 128 * 160. We can represent 2^20480 > 10^6000 accurately, as
+    // binary128 needs. This bignum can encode much bigger numbers, since it
+    // contains an exponent.
+    static const int kMaxSignificantBits = 20480;
 
     Bignum() : used_bigits_(0), exponent_(0) {
     }
@@ -62,6 +63,9 @@ public:
 
     void AssignUInt16(const uint16_t value);
     void AssignUInt64(uint64_t value);
+#ifdef __SIZEOF_INT128__
+    void AssignUInt128(uint128_t value);
+#endif
     void AssignBignum(const Bignum& other);
 
     void AssignPowerUInt16(uint16_t base, const int exponent);
@@ -199,6 +203,17 @@ void Bignum::AssignUInt64(uint64_t value) {
     }
 }
 
+#ifdef __SIZEOF_INT128__
+void Bignum::AssignUInt128(uint128_t value) {
+    Zero();
+    for(int i = 0; value > 0; ++i) {
+        RawBigit(i) = Chunk(value) & kBigitMask;
+        value >>= kBigitSize;
+        ++used_bigits_;
+    }
+}
+#endif
+
 void Bignum::AssignBignum(const Bignum& other) {
     exponent_ = other.exponent_;
     for(int i = 0; i < other.used_bigits_; ++i) {
@@ -796,8 +811,9 @@ void Bignum::SubtractTimes(const Bignum& other, const int factor) {
 // Precondition: 0 <= (numerator+delta_plus) / denominator < 10.
 //   If 1 <= (numerator+delta_plus) / denominator < 10 then no leading 0 digit
 //   will be produced. This should be the standard precondition.
+template<class Context>
 void GenerateShortestDigits(
-    double_format_context& dbl, Bignum& numerator, Bignum& denominator,
+    Context& dbl, Bignum& numerator, Bignum& denominator,
     Bignum* delta_minus, Bignum* delta_plus, bool is_even) {
     // Small optimization: if delta_minus and delta_plus are the same just reuse
     // one of the two bignums.
@@ -899,9 +915,9 @@ void GenerateShortestDigits(
 // to round up or down. Remainders of exactly .5 round upwards. Numbers such
 // as 9.999999 propagate a carry all the way, and change the
 // exponent (decimal_point), when rounding upwards.
+template<class Context>
 void GenerateCountedDigits(
-    double_format_context& dbl, int count, Bignum& numerator,
-    Bignum& denominator) {
+    Context& dbl, int count, Bignum& numerator, Bignum& denominator) {
     assert(count >= 0);
     for(int i = 0; i < count - 1; ++i) {
         uint16_t digit = numerator.DivideModuloIntBignum(denominator);
@@ -924,7 +940,7 @@ void GenerateCountedDigits(
     for(int i = count - 1; i > 0; --i) {
         if(!dbl.check_digit_overflow(i))
             break;
-        dbl.digits[i] = byte('0');
+        dbl.set_digit(i, '0');
         dbl.round_up_digit(i - 1);
     }
     if(dbl.check_digit_overflow(0)) {
@@ -939,8 +955,8 @@ void GenerateCountedDigits(
 // generated (ex.: 2 fixed digits for 0.00001).
 //
 // Input verifies:  1 <= (numerator + delta) / denominator < 10.
-void BignumToFixed(
-    double_format_context& dbl, Bignum& numerator, Bignum& denominator) {
+template<class Context>
+void BignumToFixed(Context& dbl, Bignum& numerator, Bignum& denominator) {
     // Note that we have to look at more than just the requested_digits, since
     // a number could be rounded up. Example: v=0.5 with requested_digits=0.
     // Even though the power of v equals 0 we can't just stop here.
@@ -980,7 +996,8 @@ void BignumToFixed(
 }
 
 // Returns an estimation of k such that 10^(k-1) <= v < 10^k where
-// v = f * 2^exponent and 2^52 <= f < 2^53.
+// v = f * 2^exponent and 2^52 <= f < 2^53 (2^(p-1) <= f < 2^p for the
+// significand size p of the format).
 // v is hence a normalized double with the given exponent. The output is an
 // approximation for the exponent of the decimal approimation .digits * 10^k.
 //
@@ -994,7 +1011,7 @@ void BignumToFixed(
 //  EstimatePower(-52) => 0
 //
 // Note: e >= 0 => EstimatedPower(e) > 0. No similar claim can be made for e<0.
-int EstimatePower(int exponent) {
+int EstimatePower(int exponent, int significand_size) {
     // This function estimates log10 of v where v = f*2^e (with e == exponent).
     // Note that 10^floor(log10(v)) <= v, but v <= 10^ceil(log10(v)).
     // Note that f is bounded by its container size. Let p = 53 (the double's
@@ -1020,14 +1037,25 @@ int EstimatePower(int exponent) {
     const double k1Log10 = 0.30102999566398114; // 1/lg(10)
 
     // For doubles len(f) == 53 (don't forget the hidden bit).
-    const int kSignificandSize = Double::kSignificandSize;
-    double estimate = ceil((exponent + kSignificandSize - 1) * k1Log10 - 1e-10);
+    double estimate =
+        ceil((exponent + significand_size - 1) * k1Log10 - 1e-10);
     return static_cast<int>(estimate);
 }
 
+void AssignSignificand(Bignum* bignum, uint64_t significand) {
+    bignum->AssignUInt64(significand);
+}
+
+#ifdef __SIZEOF_INT128__
+void AssignSignificand(Bignum* bignum, uint128_t significand) {
+    bignum->AssignUInt128(significand);
+}
+#endif
+
 // See comments for InitialScaledStartValues.
+template<class Significand>
 void InitialScaledStartValuesPositiveExponent(
-    uint64_t significand, int exponent, int estimated_power,
+    Significand significand, int exponent, int estimated_power,
     bool need_boundary_deltas, Bignum* numerator, Bignum* denominator,
     Bignum* delta_minus, Bignum* delta_plus) {
     // A positive exponent implies a positive power.
@@ -1036,7 +1064,7 @@ void InitialScaledStartValuesPositiveExponent(
     // by 10^estimated_power.
 
     // numerator = v.
-    numerator->AssignUInt64(significand);
+    AssignSignificand(numerator, significand);
     numerator->ShiftLeft(exponent);
     // denominator = 10^estimated_power.
     denominator->AssignPowerUInt16(10, estimated_power);
@@ -1057,8 +1085,9 @@ void InitialScaledStartValuesPositiveExponent(
 }
 
 // See comments for InitialScaledStartValues
+template<class Significand>
 static void InitialScaledStartValuesNegativeExponentPositivePower(
-    uint64_t significand, int exponent, int estimated_power,
+    Significand significand, int exponent, int estimated_power,
     bool need_boundary_deltas, Bignum* numerator, Bignum* denominator,
     Bignum* delta_minus, Bignum* delta_plus) {
     // v = f * 2^e with e < 0, and with estimated_power >= 0.
@@ -1068,7 +1097,7 @@ static void InitialScaledStartValuesNegativeExponentPositivePower(
     // numerator = significand
     //  since v = significand * 2^exponent this is equivalent to
     //  numerator = v * / 2^-exponent
-    numerator->AssignUInt64(significand);
+    AssignSignificand(numerator, significand);
     // denominator = 10^estimated_power * 2^-exponent (with exponent < 0)
     denominator->AssignPowerUInt16(10, estimated_power);
     denominator->ShiftLeft(-exponent);
@@ -1089,8 +1118,9 @@ static void InitialScaledStartValuesNegativeExponentPositivePower(
 }
 
 // See comments for InitialScaledStartValues
+template<class Significand>
 static void InitialScaledStartValuesNegativeExponentNegativePower(
-    uint64_t significand, int exponent, int estimated_power,
+    Significand significand, int exponent, int estimated_power,
     bool need_boundary_deltas, Bignum* numerator, Bignum* denominator,
     Bignum* delta_minus, Bignum* delta_plus) {
     // Instead of multiplying the denominator with 10^estimated_power we
@@ -1114,7 +1144,14 @@ static void InitialScaledStartValuesNegativeExponentNegativePower(
     // Remember: numerator has been abused as power_ten. So no need to assign it
     //  to itself.
     assert(numerator == power_ten);
-    numerator->MultiplyByUInt64(significand);
+    if constexpr(sizeof(Significand) <= sizeof(uint64_t))
+        numerator->MultiplyByUInt64(significand);
+    else {
+        // A wider significand does not fit a multiplier, so the power of ten
+        // is multiplied into it instead.
+        AssignSignificand(numerator, significand);
+        numerator->MultiplyByPowerOfTen(-estimated_power);
+    }
 
     // denominator = 2 * 2^-exponent with exponent < 0.
     denominator->AssignUInt16(1);
@@ -1172,8 +1209,9 @@ static void InitialScaledStartValuesNegativeExponentNegativePower(
 // The boundary-deltas are only filled if the mode equals BIGNUM_DTOA_SHORTEST
 // or BIGNUM_DTOA_SHORTEST_SINGLE.
 
+template<class Significand>
 static void InitialScaledStartValues(
-    uint64_t significand, int exponent, bool lower_boundary_is_closer,
+    Significand significand, int exponent, bool lower_boundary_is_closer,
     int estimated_power, bool need_boundary_deltas, Bignum* numerator,
     Bignum* denominator, Bignum* delta_minus, Bignum* delta_plus) {
     if(exponent >= 0) {
@@ -1247,19 +1285,20 @@ void FixupMultiply10(
     }
 }
 
-} // namespace
-
-void bignum_dtoa(double_format_context& dbl, dtoa_mode mode) {
-    uint64_t significand = dbl.significand;
+template<class Context>
+void BignumDtoa(Context& dbl, dtoa_mode mode, int significand_size) {
+    auto significand = dbl.significand;
     int exponent = dbl.exponent;
     bool lower_boundary_is_closer = dbl.lower_boundary_is_closer();
 
     bool need_boundary_deltas = mode == dtoa_mode::SHORTEST;
 
     bool is_even = (significand & 1) == 0;
-    int normalized_exponent = NormalizedExponent(significand, exponent);
+    int normalized_exponent =
+        NormalizedExponent(significand, exponent, significand_size);
     // estimated_power might be too low by 1.
-    int estimated_power = EstimatePower(normalized_exponent);
+    int estimated_power =
+        EstimatePower(normalized_exponent, significand_size);
 
     // Shortcut for Fixed.
     // The requested digits correspond to the digits after the point. If the
@@ -1281,8 +1320,9 @@ void bignum_dtoa(double_format_context& dbl, dtoa_mode mode) {
     // Make sure the bignum can grow large enough. The smallest double equals
     // 4e-324. In this case the denominator needs fewer than 324*4 binary
     // digits. The maximum double is 1.7976931348623157e308 which needs fewer
-    // than 308*4 binary digits.
-    assert(Bignum::kMaxSignificantBits >= 324 * 4);
+    // than 308*4 binary digits. The smallest binary128 value, 6e-4966, needs
+    // fewer than 4966*4.
+    assert(Bignum::kMaxSignificantBits >= 4966 * 4);
     InitialScaledStartValues(
         significand, exponent, lower_boundary_is_closer, estimated_power,
         need_boundary_deltas, &numerator, &denominator, &delta_minus,
@@ -1310,6 +1350,18 @@ void bignum_dtoa(double_format_context& dbl, dtoa_mode mode) {
     }
 }
 
+} // namespace
+
+void bignum_dtoa(double_format_context& dbl, dtoa_mode mode) {
+    BignumDtoa(dbl, mode, Double::kSignificandSize);
+}
+
+#ifdef __SIZEOF_INT128__
+void bignum_dtoa(wide_format_context& dbl, dtoa_mode mode) {
+    BignumDtoa(dbl, mode, dbl.significand_size);
+}
+#endif
+
 } // namespace detail
 } // namespace fmt
 } // namespace univang
@@ -0,0 +1,210 @@
+#include "format_double.hpp"
+#include "format_integer.hpp"
+
+namespace univang {
+namespace fmt {
+namespace detail {
+
+// Exact digits for the fixed and precision modes in bounded time. The value
+// c * 2^q is split into its integral part and a binary fraction held in fixed
+// size 32-bit limbs; the integral part is converted by dividing by 10^9 and
+// the fraction by multiplying with 10^9, nine digits per pass over the
+// non-zero limbs. A double has at most 309 integral and 1074 fraction digits,
+// so the work is bounded without the quotient estimation of a general bignum.
+
+namespace {
+
+constexpr uint32_t chunk_base = 1000000000;
+constexpr unsigned chunk_digits = 9;
+// 2^1024 and 2^-1074 with the 53-bit significand.
+constexpr unsigned max_integral_limbs = (1024 + 31) / 32;
+constexpr unsigned max_fraction_limbs = (1074 + 31) / 32;
+
+class digit_writer {
+public:
+    explicit digit_writer(double_format_context& dbl) noexcept : dbl_(dbl) {
+    }
+
+    unsigned count() const noexcept {
+        return dbl_.digit_count;
+    }
+    bool started() const noexcept {
+        return dbl_.digit_count != 0;
+    }
+    // Appends the leading chunk without its leading zeros.
+    void add_first(uint32_t chunk) noexcept {
+        auto len = count_digits(chunk);
+        assert(len <= double_format_context::max_decimal_digits);
+        write_dec(dbl_.digits, len, chunk);
+        dbl_.digit_count = len;
+    }
+    void add(uint32_t chunk) noexcept {
+        assert(
+            dbl_.digit_count + chunk_digits
+            <= double_format_context::max_decimal_digits);
+        write_dec_fixed<chunk_digits>(dbl_.digits + dbl_.digit_count, chunk);
+        dbl_.digit_count += chunk_digits;
+    }
+
+private:
+    double_format_context& dbl_;
+};
+
+// Writes the digits of c * 2^q, q >= 0, and returns their count.
+unsigned write_integral(digit_writer& out, uint64_t c, int q) noexcept {
+    if(q < 11) {
+        c <<= q;
+        auto hi = c / (uint64_t(chunk_base) * chunk_base);
+        auto mid = c / chunk_base % chunk_base;
+        if(hi != 0) {
+            out.add_first(uint32_t(hi));
+            out.add(uint32_t(mid));
+        }
+        else if(mid != 0)
+            out.add_first(uint32_t(mid));
+        if(out.started())
+            out.add(uint32_t(c % chunk_base));
+        else
+            out.add_first(uint32_t(c % chunk_base));
+        return out.count();
+    }
+    uint32_t limbs[max_integral_limbs + 1] = {};
+    auto shift = unsigned(q) % 32;
+    auto index = unsigned(q) / 32;
+    limbs[index] = uint32_t(c << shift);
+    limbs[index + 1] = uint32_t(c << shift >> 32);
+    limbs[index + 2] = shift != 0 ? uint32_t(c >> (64 - shift)) : 0;
+    auto size = index + 3;
+    while(limbs[size - 1] == 0)
+        --size;
+    // Chunks come out from the least significant end.
+    uint32_t chunks[(309 + chunk_digits - 1) / chunk_digits];
+    unsigned chunk_count = 0;
+    while(size != 0) {
+        uint64_t rem = 0;
+        for(auto i = size; i-- != 0;) {
+            auto cur = rem << 32 | limbs[i];
+            limbs[i] = uint32_t(cur / chunk_base);
+            rem = cur % chunk_base;
+        }
+        chunks[chunk_count++] = uint32_t(rem);
+        while(size != 0 && limbs[size - 1] == 0)
+            --size;
+    }
+    out.add_first(chunks[--chunk_count]);
+    while(chunk_count != 0)
+        out.add(chunks[--chunk_count]);
+    return out.count();
+}
+
+// Appends the digits of the fraction f / 2^e, 0 < f < 2^e, until the
+// fraction is exhausted, max_positions digits after the point are produced
+// or max_digits are stored. Returns the number of zeros after the point
+// that were skipped because nothing was stored yet.
+int write_fraction(
+    digit_writer& out, uint64_t f, unsigned e, unsigned max_positions,
+    unsigned max_digits) noexcept {
+    // f * 2^(32 * size - e) / 2^(32 * size): with the binary point above the
+    // top limb, the carry out of it is the next chunk of digits.
+    uint32_t limbs[max_fraction_limbs + 2] = {};
+    auto size = int(e + 31) / 32;
+    auto shift = unsigned(32 * size) - e;
+    limbs[0] = uint32_t(f << shift);
+    limbs[1] = uint32_t(f << shift >> 32);
+    limbs[2] = shift != 0 ? uint32_t(f >> (64 - shift)) : 0;
+    // Only limbs lo..hi are non-zero.
+    int lo = 0;
+    int hi = 2;
+    while(limbs[hi] == 0)
+        --hi;
+    while(limbs[lo] == 0)
+        ++lo;
+    int zeros = 0;
+    unsigned positions = 0;
+    while(positions < max_positions && out.count() < max_digits) {
+        uint64_t carry = 0;
+        for(auto i = lo; i <= hi; ++i) {
+            auto cur = uint64_t(limbs[i]) * chunk_base + carry;
+            limbs[i] = uint32_t(cur);
+            carry = cur >> 32;
+        }
+        uint32_t chunk = 0;
+        if(hi + 1 < size) {
+            if(carry != 0)
+                limbs[++hi] = uint32_t(carry);
+        }
+        else
+            chunk = uint32_t(carry);
+        positions += chunk_digits;
+        if(out.started())
+            out.add(chunk);
+        else if(chunk == 0)
+            zeros += chunk_digits;
+        else {
+            zeros += int(chunk_digits - count_digits(chunk));
+            out.add_first(chunk);
+        }
+        // Every pass appends nine zero bits at the low end.
+        while(lo <= hi && limbs[lo] == 0)
+            ++lo;
+        if(lo > hi)
+            break;
+    }
+    return zeros;
+}
+
+// Rounds half up to the first cut stored digits.
+void round_digits(double_format_context& dbl, int cut) noexcept {
+    if(cut >= int(dbl.digit_count))
+        return;
+    bool up = cut >= 0 && dbl.digit(unsigned(cut)) >= '5';
+    dbl.digit_count = unsigned((std::max)(cut, 0));
+    if(!up)
+        return;
+    if(dbl.digit_count == 0) {
+        dbl.add_digit('1');
+        ++dbl.decimal_point;
+    }
+    else if(dbl.round_up())
+        ++dbl.decimal_point;
+}
+
+} // namespace
+
+void exact_dtoa(double_format_context& dbl, dtoa_mode mode) {
+    assert(mode != dtoa_mode::SHORTEST && dbl.value != 0);
+    const bool fixed = mode == dtoa_mode::FIXED;
+    const auto requested = unsigned((std::max)(dbl.requested_digits, 0));
+    const uint64_t c = dbl.significand;
+    const int q = dbl.exponent;
+    dbl.digit_count = 0;
+    digit_writer out(dbl);
+    if(q >= 0)
+        dbl.decimal_point = int(write_integral(out, c, q));
+    else {
+        auto e = unsigned(-q);
+        uint64_t integral = e < 64 ? c >> e : 0;
+        uint64_t fraction = e < 64 ? c & ((uint64_t(1) << e) - 1) : c;
+        int integral_digits = 0;
+        if(integral != 0)
+            integral_digits = int(write_integral(out, integral, 0));
+        int zeros = 0;
+        // One more digit than requested decides the rounding.
+        if(fraction != 0) {
+            zeros = write_fraction(
+                out, fraction, e, fixed ? requested + 1 : UINT_MAX,
+                fixed ? UINT_MAX : requested + 1);
+        }
+        dbl.decimal_point = integral_digits - zeros;
+    }
+    round_digits(
+        dbl, fixed ? dbl.decimal_point + int(requested) : int(requested));
+    while(dbl.digit_count != 0 && dbl.last_digit() == '0')
+        --dbl.digit_count;
+    if(dbl.digit_count == 0)
+        dbl.decimal_point = -int(requested);
+}
+
+} // namespace detail
+} // namespace fmt
+} // namespace univang
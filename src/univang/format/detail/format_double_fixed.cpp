@@ -42,22 +42,16 @@ struct uint128_t {
 
 template<class T>
 void write_digits(double_format_context& dbl, T number) {
-    char tmp[sizeof(T) * 3];
-    auto pos = write_dec(tmp, sizeof(tmp), number);
-    auto size = sizeof(tmp) - pos;
-    std::memcpy(dbl.digits + dbl.digit_count, tmp + pos, size);
+    auto size = count_digits(number);
+    assert(
+        dbl.digit_count + size <= double_format_context::max_decimal_digits);
+    write_dec(dbl.digits + dbl.digit_count, size, number);
     dbl.digit_count += size;
 }
 
 void write_17_digits(double_format_context& dbl, uint64_t number) {
-    char tmp[20];
-    auto pos = write_dec(tmp, sizeof(tmp), number);
-    auto size = sizeof(tmp) - pos;
-    assert(size <= 17);
-    auto* digits = dbl.digits + dbl.digit_count;
-    auto padding = 17 - size;
-    std::memset(digits, '0', padding);
-    std::memcpy(digits + padding, tmp + pos, size);
+    assert(count_digits(number) <= 17);
+    write_dec_fixed<17>(dbl.digits + dbl.digit_count, number);
     dbl.digit_count += 17;
 }
 
@@ -123,8 +117,11 @@ void write_fraction_digits(double_format_context& dbl, uint64_t fractionals) {
     }
     // We need 128 bits.
     assert(64 < -exponent && -exponent <= 128);
-    uint128_t f128{fractionals >> (-exponent - 64),
-                   fractionals << (128 + exponent)};
+    // Shifting a 64 bit value by 64 is undefined.
+    int shift = -exponent - 64;
+    uint128_t f128 = shift == 64
+        ? uint128_t{0, fractionals}
+        : uint128_t{fractionals >> shift, fractionals << (64 - shift)};
     int point = 128;
     for(int i = 0; i < fractional_count; ++i) {
         if(f128.hi == 0 && f128.lo == 0)
@@ -132,7 +129,7 @@ void write_fraction_digits(double_format_context& dbl, uint64_t fractionals) {
         // x *= 5.
         const uint32_t mask = 0xffffffff;
         uint64_t accumulator = (f128.lo & mask) * 5;
-        uint32_t part = static_cast<uint32_t>(5 & mask);
+        uint32_t part = static_cast<uint32_t>(accumulator & mask);
         accumulator >>= 32;
         accumulator += (f128.lo >> 32) * 5;
         f128.lo = (accumulator << 32) + part;
@@ -33,26 +33,28 @@ namespace detail {
 
 namespace {
 
-using byte = double_format_context::byte;
-
 // This "Do It Yourself Floating Point" class implements a floating-point number
-// with a uint64 significand and an int exponent. Normalized DiyFp numbers will
-// have the most significant bit of the significand set.
+// with an unsigned significand and an int exponent: uint64 for doubles and
+// uint128 for the wider formats. Normalized DiyFp numbers will have the most
+// significant bit of the significand set.
 // Multiplication and Subtraction do not normalize their results.
 // DiyFp store only non-negative numbers and are not designed to contain special
 // doubles (NaN and Infinity).
-class DiyFp {
+template<class Significand>
+class BasicDiyFp {
 public:
-    constexpr static const int kSignificandSize = 64;
+    constexpr static const int kSignificandSize = sizeof(Significand) * 8;
 
-    constexpr DiyFp() noexcept : f_(0), e_(0) {
+    constexpr BasicDiyFp() noexcept : f_(0), e_(0) {
     }
-    constexpr DiyFp(const uint64_t significand, const int32_t exponent) noexcept
+    constexpr BasicDiyFp(
+        const Significand significand, const int32_t exponent) noexcept
         : f_(significand), e_(exponent) {
     }
 
     // The value encoded by this Double must be strictly greater than 0.
-    static DiyFp MakeNormalized(const double_format_context& dbl) noexcept {
+    static BasicDiyFp MakeNormalized(
+        const double_format_context& dbl) noexcept {
         auto f = dbl.significand;
         auto e = dbl.exponent;
         while((f & Double::kHiddenBit) == 0) {
@@ -62,16 +64,30 @@ public:
         // Do the final shifts in one go.
         f <<= kSignificandSize - Double::kSignificandSize;
         e -= kSignificandSize - Double::kSignificandSize;
-        return DiyFp(f, e);
+        return BasicDiyFp(f, e);
     }
+#ifdef __SIZEOF_INT128__
+    static BasicDiyFp MakeNormalized(const wide_format_context& dbl) noexcept {
+        auto f = dbl.significand;
+        auto e = dbl.exponent;
+        while((f & dbl.hidden_bit) == 0) {
+            f <<= 1;
+            --e;
+        }
+        f <<= kSignificandSize - dbl.significand_size;
+        e -= kSignificandSize - dbl.significand_size;
+        return BasicDiyFp(f, e);
+    }
+#endif
 
     // Computes the two boundaries of this.
     // The bigger boundary (m_plus) is normalized. The lower boundary has the
     // same exponent as m_plus. Precondition: the value encoded by this Double
     // must be greater than 0.
+    template<class Context>
     static void NormalizedBoundaries(
-        const double_format_context& dbl, DiyFp* out_m_minus,
-        DiyFp* out_m_plus) noexcept {
+        const Context& dbl, BasicDiyFp* out_m_minus,
+        BasicDiyFp* out_m_plus) noexcept {
         // The boundary is closer if the significand is of the form f == 2^p-1
         // then the lower boundary is closer. Think of v = 1000e10 and v- =
         // 9999e9. Then the boundary (== (v - v-)/2) is not just at a distance
@@ -80,13 +96,14 @@ public:
         // successor. Note: denormals have the same exponent as the smallest
         // normals.
         bool lower_boundary_is_closer = dbl.lower_boundary_is_closer();
-        DiyFp v = DiyFp(dbl.significand, dbl.exponent);
-        DiyFp m_plus = DiyFp::Normalize(DiyFp((v.f() << 1) + 1, v.e() - 1));
-        DiyFp m_minus;
+        BasicDiyFp v = BasicDiyFp(dbl.significand, dbl.exponent);
+        BasicDiyFp m_plus =
+            Normalize(BasicDiyFp((v.f() << 1) + 1, v.e() - 1));
+        BasicDiyFp m_minus;
         if(lower_boundary_is_closer)
-            m_minus = DiyFp((v.f() << 2) - 1, v.e() - 2);
+            m_minus = BasicDiyFp((v.f() << 2) - 1, v.e() - 2);
         else
-            m_minus = DiyFp((v.f() << 1) - 1, v.e() - 1);
+            m_minus = BasicDiyFp((v.f() << 1) - 1, v.e() - 1);
         m_minus.set_f(m_minus.f() << (m_minus.e() - m_plus.e()));
         m_minus.set_e(m_plus.e());
         *out_m_plus = m_plus;
@@ -97,7 +114,7 @@ public:
     // The exponents of both numbers must be the same and the significand of
     // this must be greater or equal than the significand of other. The result
     // will not be normalized.
-    void Subtract(const DiyFp& other) noexcept {
+    void Subtract(const BasicDiyFp& other) noexcept {
         assert(e_ == other.e_);
         assert(f_ >= other.f_);
         f_ -= other.f_;
@@ -106,56 +123,60 @@ public:
     // Returns a - b.
     // The exponents of both numbers must be the same and a must be greater
     // or equal than b. The result will not be normalized.
-    static DiyFp Minus(const DiyFp& a, const DiyFp& b) noexcept {
-        DiyFp result = a;
+    static BasicDiyFp Minus(
+        const BasicDiyFp& a, const BasicDiyFp& b) noexcept {
+        BasicDiyFp result = a;
         result.Subtract(b);
         return result;
     }
 
     // this *= other.
-    void Multiply(const DiyFp& other) noexcept {
-        // Simply "emulates" a 128 bit multiplication.
-        // However: the resulting number only contains 64 bits. The least
-        // significant 64 bits are only used for rounding the most significant
-        // 64 bits.
-        const uint64_t kM32 = 0xFFFFFFFFU;
-        const uint64_t a = f_ >> 32;
-        const uint64_t b = f_ & kM32;
-        const uint64_t c = other.f_ >> 32;
-        const uint64_t d = other.f_ & kM32;
-        const uint64_t ac = a * c;
-        const uint64_t bc = b * c;
-        const uint64_t ad = a * d;
-        const uint64_t bd = b * d;
-        // By adding 1U << 31 to tmp we round the final result.
+    void Multiply(const BasicDiyFp& other) noexcept {
+        // Simply "emulates" a multiplication of twice the significand size.
+        // However: the resulting number only contains kSignificandSize bits.
+        // The least significant half is only used for rounding the most
+        // significant one.
+        constexpr int kHalf = kSignificandSize / 2;
+        const Significand kMask = (Significand(1) << kHalf) - 1;
+        const Significand a = f_ >> kHalf;
+        const Significand b = f_ & kMask;
+        const Significand c = other.f_ >> kHalf;
+        const Significand d = other.f_ & kMask;
+        const Significand ac = a * c;
+        const Significand bc = b * c;
+        const Significand ad = a * d;
+        const Significand bd = b * d;
+        // By adding 1 << (kHalf - 1) to tmp we round the final result.
         // Halfway cases will be rounded up.
-        const uint64_t tmp =
-            (bd >> 32) + (ad & kM32) + (bc & kM32) + (1U << 31);
-        e_ += other.e_ + 64;
-        f_ = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+        const Significand tmp = (bd >> kHalf) + (ad & kMask) + (bc & kMask)
+            + (Significand(1) << (kHalf - 1));
+        e_ += other.e_ + kSignificandSize;
+        f_ = ac + (ad >> kHalf) + (bc >> kHalf) + (tmp >> kHalf);
     }
 
     // returns a * b;
-    static DiyFp Times(const DiyFp& a, const DiyFp& b) noexcept {
-        DiyFp result = a;
+    static BasicDiyFp Times(
+        const BasicDiyFp& a, const BasicDiyFp& b) noexcept {
+        BasicDiyFp result = a;
         result.Multiply(b);
         return result;
     }
 
     void Normalize() noexcept {
         assert(f_ != 0);
-        uint64_t significand = f_;
+        Significand significand = f_;
         int32_t exponent = e_;
 
         // This method is mainly called for normalizing boundaries. In general,
         // boundaries need to be shifted by 10 bits, and we optimize for this
         // case.
-        const uint64_t k10MSBits = 0xFFC0000000000000llu;
+        const Significand k10MSBits = Significand(0x3FF)
+            << (kSignificandSize - 10);
         while((significand & k10MSBits) == 0) {
             significand <<= 10;
             exponent -= 10;
         }
-        while((significand & kUint64MSB) == 0) {
+        while((significand & kMSB) == 0) {
             significand <<= 1;
             exponent--;
         }
@@ -163,20 +184,20 @@ public:
         e_ = exponent;
     }
 
-    static DiyFp Normalize(const DiyFp& a) noexcept {
-        DiyFp result = a;
+    static BasicDiyFp Normalize(const BasicDiyFp& a) noexcept {
+        BasicDiyFp result = a;
         result.Normalize();
         return result;
     }
 
-    uint64_t f() const {
+    Significand f() const {
         return f_;
     }
     int32_t e() const {
         return e_;
     }
 
-    void set_f(uint64_t new_value) {
+    void set_f(Significand new_value) {
         f_ = new_value;
     }
     void set_e(int32_t new_value) {
@@ -184,12 +205,15 @@ public:
     }
 
 private:
-    static constexpr const uint64_t kUint64MSB = 0x8000000000000000llu;
+    static constexpr const Significand kMSB = Significand(1)
+        << (kSignificandSize - 1);
 
-    uint64_t f_;
+    Significand f_;
     int32_t e_;
 };
 
+using DiyFp = BasicDiyFp<uint64_t>;
+
 namespace PowersOfTenCache {
 
 struct CachedPower {
@@ -274,6 +298,138 @@ void GetCachedPowerForBinaryExponentRange(
     *power = DiyFp(cached_power.significand, cached_power.binary_exponent);
 }
 
+#ifdef __SIZEOF_INT128__
+using WideDiyFp = BasicDiyFp<uint128_t>;
+
+// The wide formats span decimal exponents up to about +-4950, too many to
+// list, so their powers are computed once when first used: in exact steps of
+// 10^8 on a 256-bit significand, truncating every product and quotient, and
+// then rounded to 128 bits. The truncation errors stay far below the
+// rounding, so the powers are as precise as the ones of the table above.
+constexpr const int kWideMinDecimalExponent = -4944;
+constexpr const int kWideMaxDecimalExponent = 4984;
+
+struct WideCachedPower {
+    uint128_t significand;
+    int16_t binary_exponent;
+    int16_t decimal_exponent;
+};
+
+class WideCachedPowers {
+public:
+    static constexpr int kCount =
+        (kWideMaxDecimalExponent - kWideMinDecimalExponent)
+            / kDecimalExponentDistance
+        + 1;
+
+    WideCachedPowers() noexcept {
+        const int zero_index =
+            -kWideMinDecimalExponent / kDecimalExponentDistance;
+        uint64_t f[4];
+        int e;
+        SetOne(f, e);
+        Store(zero_index, f, e);
+        for(int i = zero_index + 1; i < kCount; ++i) {
+            MultiplyStep(f, e);
+            Store(i, f, e);
+        }
+        SetOne(f, e);
+        for(int i = zero_index - 1; i >= 0; --i) {
+            DivideStep(f, e);
+            Store(i, f, e);
+        }
+    }
+
+    const WideCachedPower& operator[](int index) const noexcept {
+        assert(0 <= index && index < kCount);
+        return powers_[index];
+    }
+
+private:
+    // 10^kDecimalExponentDistance.
+    static constexpr uint64_t kStep = 100000000;
+
+    // The 256-bit significands are normalized, limbs from the least
+    // significant one.
+    static void SetOne(uint64_t (&f)[4], int& e) noexcept {
+        f[0] = f[1] = f[2] = 0;
+        f[3] = uint64_t(1) << 63;
+        e = -255;
+    }
+
+    // Keeps the top 256 bits of p, whose top limb is not zero.
+    static void ShiftOut(
+        const uint64_t (&p)[5], uint64_t (&f)[4], int& e) noexcept {
+        assert(p[4] != 0);
+        int shift = 64 - __builtin_clzll(p[4]);
+        for(int i = 0; i < 4; ++i) {
+            f[i] = shift == 64 ? p[i + 1]
+                               : p[i] >> shift | p[i + 1] << (64 - shift);
+        }
+        e += shift;
+    }
+
+    static void MultiplyStep(uint64_t (&f)[4], int& e) noexcept {
+        uint64_t p[5];
+        uint128_t carry = 0;
+        for(int i = 0; i < 4; ++i) {
+            carry += uint128_t(f[i]) * kStep;
+            p[i] = uint64_t(carry);
+            carry >>= 64;
+        }
+        p[4] = uint64_t(carry);
+        ShiftOut(p, f, e);
+    }
+
+    // Divides f * 2^64, so that the quotient keeps more than 256 bits.
+    static void DivideStep(uint64_t (&f)[4], int& e) noexcept {
+        uint64_t q[5];
+        uint128_t rest = 0;
+        for(int i = 4; i >= 0; --i) {
+            auto current = rest << 64 | (i != 0 ? f[i - 1] : 0);
+            q[i] = uint64_t(current / kStep);
+            rest = current % kStep;
+        }
+        e -= 64;
+        ShiftOut(q, f, e);
+    }
+
+    void Store(int index, const uint64_t (&f)[4], int e) noexcept {
+        auto significand = uint128_t(f[3]) << 64 | f[2];
+        e += 128;
+        // Round to nearest.
+        if((f[1] >> 63) != 0 && ++significand == 0) {
+            significand = uint128_t(1) << 127;
+            ++e;
+        }
+        auto& power = powers_[index];
+        power.significand = significand;
+        power.binary_exponent = int16_t(e);
+        power.decimal_exponent = int16_t(
+            kWideMinDecimalExponent + index * kDecimalExponentDistance);
+    }
+
+    WideCachedPower powers_[kCount];
+};
+
+void GetCachedPowerForBinaryExponentRange(
+    int min_exponent, int max_exponent, WideDiyFp* power,
+    int* decimal_exponent) {
+    static const WideCachedPowers powers;
+    int kQ = WideDiyFp::kSignificandSize;
+    double k = ceil((min_exponent + kQ - 1) * kD_1_LOG2_10);
+    int index = (-kWideMinDecimalExponent + static_cast<int>(k) - 1)
+            / kDecimalExponentDistance
+        + 1;
+    const auto& cached_power = powers[index];
+    assert(min_exponent <= cached_power.binary_exponent);
+    (void)max_exponent; // Mark variable as used.
+    assert(cached_power.binary_exponent <= max_exponent);
+    *decimal_exponent = cached_power.decimal_exponent;
+    *power = WideDiyFp(cached_power.significand, cached_power.binary_exponent);
+}
+#endif
+
 } // namespace PowersOfTenCache
 
 // The minimal and maximal target exponent define the range of w's binary
@@ -282,8 +438,14 @@ void GetCachedPowerForBinaryExponentRange(
 //
 // A different range might be chosen on a different platform, to optimize digit
 // generation, but a smaller range requires more powers of ten to be cached.
-constexpr const int kMinimalTargetExponent = -60;
-constexpr const int kMaximalTargetExponent = -32;
+// The range of the 128-bit DiyFp is as far from its significand size: the
+// integrals fit in 32 bits and the fractionals times 10 do not overflow.
+template<class Significand>
+constexpr const int kMinimalTargetExponent =
+    4 - static_cast<int>(sizeof(Significand) * 8);
+template<class Significand>
+constexpr const int kMaximalTargetExponent =
+    32 - static_cast<int>(sizeof(Significand) * 8);
 
 // Adjusts the last digit of the generated number, and screens out generated
 // solutions that may be inaccurate. A solution may be inaccurate if it is
@@ -300,12 +462,12 @@ constexpr const int kMaximalTargetExponent = -32;
 // Output: returns true if the buffer is guaranteed to contain the closest
 //    representable number to the input.
 //  Modifies the generated digits in the buffer to approach (round towards) w.
+template<class Context, class Significand>
 bool RoundWeed(
-    double_format_context& dbl, uint64_t distance_too_high_w,
-    uint64_t unsafe_interval, uint64_t rest, uint64_t ten_kappa,
-    uint64_t unit) {
-    uint64_t small_distance = distance_too_high_w - unit;
-    uint64_t big_distance = distance_too_high_w + unit;
+    Context& dbl, Significand distance_too_high_w, Significand unsafe_interval,
+    Significand rest, Significand ten_kappa, Significand unit) {
+    Significand small_distance = distance_too_high_w - unit;
+    Significand big_distance = distance_too_high_w + unit;
     // Let w_low  = too_high - big_distance, and
     //     w_high = too_high - small_distance.
     // Note: w_low < w < w_high
@@ -421,9 +583,10 @@ bool RoundWeed(
 // unambiguously determined.
 //
 // Precondition: rest < ten_kappa.
+template<class Context, class Significand>
 bool RoundWeedCounted(
-    double_format_context& dbl, uint64_t rest, uint64_t ten_kappa,
-    uint64_t unit, int& kappa) {
+    Context& dbl, Significand rest, Significand ten_kappa, Significand unit,
+    int& kappa) {
     assert(rest < ten_kappa);
     // The following tests are done in a specific order to avoid overflows. They
     // will work correctly with any uint64 values of rest < ten_kappa and unit.
@@ -538,13 +701,14 @@ void BiggestPowerTen(
 // represent 'w' we can stop. Everything inside the interval low - high
 // represents w. However we have to pay attention to low, high and w's
 // imprecision.
+template<class Context, class Significand>
 bool DigitGen(
-    double_format_context& dbl, int exponent, uint64_t significand,
-    uint64_t low, uint64_t high) {
+    Context& dbl, int exponent, Significand significand, Significand low,
+    Significand high) {
     assert(low + 1 <= high - 1);
     assert(
-        exponent >= kMinimalTargetExponent
-        && exponent <= kMaximalTargetExponent);
+        exponent >= kMinimalTargetExponent<Significand>
+        && exponent <= kMaximalTargetExponent<Significand>);
     // low, w and high are imprecise, but by less than one ulp (unit in the last
     // place).
     // If we remove (resp. add) 1 ulp from low (resp. high) we are certain that
@@ -568,13 +732,13 @@ bool DigitGen(
     // buffer) such that:   too_low < buffer * 10^kappa < too_high We use
     // too_high for the digit_generation and stop as soon as possible. If we
     // stop early we effectively round down.
-    uint64_t one = static_cast<uint64_t>(1) << -exponent;
+    Significand one = static_cast<Significand>(1) << -exponent;
     // Division by one is a shift.
     uint32_t integrals = static_cast<uint32_t>(too_high >> -exponent);
     // Modulo by one is an and.
-    uint64_t fractionals = too_high & (one - 1);
-    auto pow10 =
-        greater_power_of_ten(integrals, DiyFp::kSignificandSize - (-exponent));
+    Significand fractionals = too_high & (one - 1);
+    auto pow10 = greater_power_of_ten(
+        integrals, BasicDiyFp<Significand>::kSignificandSize - (-exponent));
     dbl.decimal_point = pow10;
     // Loop invariant: buffer = too_high / 10^kappa  (integer division)
     // The invariant holds for the first iteration: kappa has been initialized
@@ -589,8 +753,8 @@ bool DigitGen(
         --dbl.decimal_point;
         // Note that kappa now equals the exponent of the divisor and that the
         // invariant thus holds again.
-        uint64_t rest =
-            (static_cast<uint64_t>(integrals) << -exponent) + fractionals;
+        Significand rest =
+            (static_cast<Significand>(integrals) << -exponent) + fractionals;
         // Invariant: too_high = buffer * 10^kappa + DiyFp(rest, one.e())
 
         if(rest < unsafe_interval) {
@@ -598,7 +762,8 @@ bool DigitGen(
             // number that lies within the unsafe interval.
             return RoundWeed(
                 dbl, too_high - significand, unsafe_interval, rest,
-                static_cast<uint64_t>(divisor) << -exponent, 1);
+                static_cast<Significand>(divisor) << -exponent,
+                static_cast<Significand>(1));
         }
         --pow10;
     }
@@ -608,11 +773,11 @@ bool DigitGen(
     // by 10 and divide by one. We just need to pay attention to multiply
     // associated data (like the interval or 'unit'), too. Note that the
     // multiplication by 10 does not overflow, because w.e >= -60 and thus one.e
-    // >= -60.
-    assert(exponent >= -60);
+    // >= -60 (-124 for the 128-bit significand).
+    assert(exponent >= kMinimalTargetExponent<Significand>);
     assert(fractionals < one);
-    assert(0xFFFFFFFFFFFFFFFFllu / 10 >= one);
-    uint64_t unit = 1;
+    assert(static_cast<Significand>(~Significand(0)) / 10 >= one);
+    Significand unit = 1;
     for(;;) {
         fractionals *= 10;
         unit *= 10;
@@ -659,26 +824,28 @@ bool DigitGen(
 //   numbers. If the precision is not enough to guarantee all the postconditions
 //   then false is returned. This usually happens rarely, but the failure-rate
 //   increases with higher requested_digits.
-bool DigitGenCounted(double_format_context& dbl, DiyFp w, int& kappa) {
-    assert(kMinimalTargetExponent <= w.e() && w.e() <= kMaximalTargetExponent);
-    assert(kMinimalTargetExponent >= -60);
-    assert(kMaximalTargetExponent <= -32);
+template<class Context, class Significand>
+bool DigitGenCounted(Context& dbl, BasicDiyFp<Significand> w, int& kappa) {
+    using Fp = BasicDiyFp<Significand>;
+    assert(
+        kMinimalTargetExponent<Significand> <= w.e()
+        && w.e() <= kMaximalTargetExponent<Significand>);
     // w is assumed to have an error less than 1 unit. Whenever w is scaled we
     // also scale its error.
-    uint64_t w_error = 1;
+    Significand w_error = 1;
     // We cut the input number into two parts: the integral digits and the
     // fractional digits. We don't emit any decimal separator, but adapt kappa
     // instead. Example: instead of writing "1.2" we put "12" into the buffer
     // and increase kappa by 1.
-    DiyFp one = DiyFp(static_cast<uint64_t>(1) << -w.e(), w.e());
+    Fp one = Fp(static_cast<Significand>(1) << -w.e(), w.e());
     // Division by one is a shift.
     uint32_t integrals = static_cast<uint32_t>(w.f() >> -one.e());
     // Modulo by one is an and.
-    uint64_t fractionals = w.f() & (one.f() - 1);
+    Significand fractionals = w.f() & (one.f() - 1);
     uint32_t divisor;
     int divisor_exponent_plus_one;
     BiggestPowerTen(
-        integrals, DiyFp::kSignificandSize - (-one.e()), &divisor,
+        integrals, Fp::kSignificandSize - (-one.e()), &divisor,
         &divisor_exponent_plus_one);
     kappa = divisor_exponent_plus_one;
 
@@ -702,10 +869,10 @@ bool DigitGenCounted(double_format_context& dbl, DiyFp w, int& kappa) {
     }
 
     if(digits_last == 0) {
-        uint64_t rest =
-            (static_cast<uint64_t>(integrals) << -one.e()) + fractionals;
+        Significand rest =
+            (static_cast<Significand>(integrals) << -one.e()) + fractionals;
         return RoundWeedCounted(
-            dbl, rest, static_cast<uint64_t>(divisor) << -one.e(), w_error,
+            dbl, rest, static_cast<Significand>(divisor) << -one.e(), w_error,
             kappa);
     }
 
@@ -713,10 +880,11 @@ bool DigitGenCounted(double_format_context& dbl, DiyFp w, int& kappa) {
     // separator. In the following loop we simply multiply the remaining digits
     // by 10 and divide by one. We just need to pay attention to multiply
     // associated data (the 'unit'), too. Note that the multiplication by 10
-    // does not overflow, because w.e >= -60 and thus one.e >= -60.
-    assert(one.e() >= -60);
+    // does not overflow, because w.e >= -60 and thus one.e >= -60 (-124 for
+    // the 128-bit significand).
+    assert(one.e() >= kMinimalTargetExponent<Significand>);
     assert(fractionals < one.f());
-    assert(0xFFFFFFFFFFFFFFFFllu / 10 >= one.f());
+    assert(static_cast<Significand>(~Significand(0)) / 10 >= one.f());
     while(digits_last != 0 && fractionals > w_error) {
         fractionals *= 10;
         w_error *= 10;
@@ -733,8 +901,6 @@ bool DigitGenCounted(double_format_context& dbl, DiyFp w, int& kappa) {
     return RoundWeedCounted(dbl, fractionals, one.f(), w_error, kappa);
 }
 
-} // namespace
-
 // Provides a decimal representation of v.
 // Returns true if it succeeds, otherwise the result cannot be trusted.
 // There will be *length digits inside the buffer (not null-terminated).
@@ -746,7 +912,9 @@ bool DigitGenCounted(double_format_context& dbl, DiyFp w, int& kappa) {
 // The last digit will be closest to the actual v. That is, even if several
 // digits might correctly yield 'v' when read again, the closest will be
 // computed.
-bool grisu3_dtoa(double_format_context& dbl) {
+template<class Context>
+bool Grisu3(Context& dbl) {
+    using DiyFp = BasicDiyFp<typename Context::significand_type>;
     DiyFp w = DiyFp::MakeNormalized(dbl);
     // boundary_minus and boundary_plus are the boundaries between v and its
     // closest floating-point neighbors. Any number strictly between
@@ -754,24 +922,28 @@ bool grisu3_dtoa(double_format_context& dbl) {
     // double. Grisu3 will never output representations that lie exactly on a
     // boundary.
     DiyFp boundary_minus, boundary_plus;
-    DiyFp::NormalizedBoundaries(dbl.value, &boundary_minus, &boundary_plus);
+    DiyFp::NormalizedBoundaries(dbl, &boundary_minus, &boundary_plus);
 
     assert(boundary_plus.e() == w.e());
     DiyFp ten_mk; // Cached power of ten: 10^-k
     int mk;       // -k
+    constexpr int kMinimalExponent =
+        kMinimalTargetExponent<typename Context::significand_type>;
+    constexpr int kMaximalExponent =
+        kMaximalTargetExponent<typename Context::significand_type>;
     int ten_mk_minimal_binary_exponent =
-        kMinimalTargetExponent - (w.e() + DiyFp::kSignificandSize);
+        kMinimalExponent - (w.e() + DiyFp::kSignificandSize);
     int ten_mk_maximal_binary_exponent =
-        kMaximalTargetExponent - (w.e() + DiyFp::kSignificandSize);
+        kMaximalExponent - (w.e() + DiyFp::kSignificandSize);
     PowersOfTenCache::GetCachedPowerForBinaryExponentRange(
         ten_mk_minimal_binary_exponent, ten_mk_maximal_binary_exponent, &ten_mk,
         &mk);
     assert(
-        (kMinimalTargetExponent <= w.e() + ten_mk.e() + DiyFp::kSignificandSize)
-        && (kMaximalTargetExponent
-            >= w.e() + ten_mk.e() + DiyFp::kSignificandSize));
+        (kMinimalExponent <= w.e() + ten_mk.e() + DiyFp::kSignificandSize)
+        && (kMaximalExponent >= w.e() + ten_mk.e() + DiyFp::kSignificandSize));
     // Note that ten_mk is only an approximation of 10^-k. A DiyFp only contains
-    // a 64 bit significand and ten_mk is thus only precise up to 64 bits.
+    // a 64 (128) bit significand and ten_mk is thus only precise up to 64
+    // (128) bits.
 
     // The DiyFp::Times procedure rounds its result, and ten_mk is approximated
     // too. The variable scaled_w (as well as scaled_boundary_minus/plus) are
@@ -813,23 +985,29 @@ bool grisu3_dtoa(double_format_context& dbl) {
 // and with enough requested digits 0.1 will at some point print as 0.9999999...
 // Grisu3 is too imprecise for real halfway cases (1.5 will not work) and
 // therefore the rounding strategy for halfway cases is irrelevant.
-bool grisu3_fixed_dtoa(double_format_context& dbl) {
+template<class Context>
+bool Grisu3Counted(Context& dbl) {
+    using DiyFp = BasicDiyFp<typename Context::significand_type>;
     DiyFp w = DiyFp::MakeNormalized(dbl);
     DiyFp ten_mk; // Cached power of ten: 10^-k
     int mk;       // -k
+    constexpr int kMinimalExponent =
+        kMinimalTargetExponent<typename Context::significand_type>;
+    constexpr int kMaximalExponent =
+        kMaximalTargetExponent<typename Context::significand_type>;
     int ten_mk_minimal_binary_exponent =
-        kMinimalTargetExponent - (w.e() + DiyFp::kSignificandSize);
+        kMinimalExponent - (w.e() + DiyFp::kSignificandSize);
     int ten_mk_maximal_binary_exponent =
-        kMaximalTargetExponent - (w.e() + DiyFp::kSignificandSize);
+        kMaximalExponent - (w.e() + DiyFp::kSignificandSize);
     PowersOfTenCache::GetCachedPowerForBinaryExponentRange(
         ten_mk_minimal_binary_exponent, ten_mk_maximal_binary_exponent, &ten_mk,
         &mk);
     assert(
-        (kMinimalTargetExponent <= w.e() + ten_mk.e() + DiyFp::kSignificandSize)
-        && (kMaximalTargetExponent
-            >= w.e() + ten_mk.e() + DiyFp::kSignificandSize));
+        (kMinimalExponent <= w.e() + ten_mk.e() + DiyFp::kSignificandSize)
+        && (kMaximalExponent >= w.e() + ten_mk.e() + DiyFp::kSignificandSize));
     // Note that ten_mk is only an approximation of 10^-k. A DiyFp only contains
-    // a 64 bit significand and ten_mk is thus only precise up to 64 bits.
+    // a 64 (128) bit significand and ten_mk is thus only precise up to 64
+    // (128) bits.
 
     // The DiyFp::Times procedure rounds its result, and ten_mk is approximated
     // too. The variable scaled_w (as well as scaled_boundary_minus/plus) are
@@ -854,6 +1032,26 @@ bool grisu3_fixed_dtoa(double_format_context& dbl) {
     return true;
 }
 
+} // namespace
+
+bool grisu3_dtoa(double_format_context& dbl) {
+    return Grisu3(dbl);
+}
+
+bool grisu3_fixed_dtoa(double_format_context& dbl) {
+    return Grisu3Counted(dbl);
+}
+
+#ifdef __SIZEOF_INT128__
+bool grisu3_dtoa(wide_format_context& dbl) {
+    return Grisu3(dbl);
+}
+
+bool grisu3_fixed_dtoa(wide_format_context& dbl) {
+    return Grisu3Counted(dbl);
+}
+#endif
+
 } // namespace detail
 } // namespace fmt
 } // namespace univang
@@ -0,0 +1,220 @@
+#include "format_double.hpp"
+#include "format_integer.hpp"
+
+namespace univang {
+namespace fmt {
+namespace detail {
+
+// Shortest round trip conversion after R. Giulietti, "The Schubfach way to
+// render doubles" (2020). The value and the boundaries of its rounding
+// interval are scaled by a 128-bit approximation of a power of ten that is
+// rounded up, which together with round-to-odd of the products keeps every
+// comparison exact, so unlike Grisu there is no fallback.
+
+namespace {
+
+struct uint128 {
+    uint64_t hi, lo;
+};
+
+inline uint128 umul128(uint64_t x, uint64_t y) noexcept {
+#if defined(__SIZEOF_INT128__)
+    auto p = static_cast<unsigned __int128>(x) * y;
+    return {uint64_t(p >> 64), uint64_t(p)};
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi;
+    uint64_t lo = _umul128(x, y, &hi);
+    return {hi, lo};
+#else
+    uint64_t a = x >> 32, b = x & 0xffffffff;
+    uint64_t c = y >> 32, d = y & 0xffffffff;
+    uint64_t ac = a * c, ad = a * d, bc = b * c, bd = b * d;
+    uint64_t mid = (bd >> 32) + (ad & 0xffffffff) + (bc & 0xffffffff);
+    return {ac + (ad >> 32) + (bc >> 32) + (mid >> 32),
+            (mid << 32) | (bd & 0xffffffff)};
+#endif
+}
+
+// floor(e * log2(10)) for |e| <= 1233.
+constexpr int floor_log2_pow10(int e) noexcept {
+    return (e * 1741647) >> 19;
+}
+
+// floor(e * log10(2)) for |e| <= 1650.
+constexpr int floor_log10_pow2(int e) noexcept {
+    return (e * 1262611) >> 22;
+}
+
+// floor(e * log10(2) + log10(3/4)) for |e| <= 1650.
+constexpr int floor_log10_three_quarters_pow2(int e) noexcept {
+    return (e * 1262611 - 524031) >> 22;
+}
+
+// g(e) = floor(10^e / 2^r) + 1 with r = floor_log2_pow10(e) - 127, so
+// 2^127 <= g(e) < 2^128. Only every 27th value is stored: the others are
+// g(base) * 5^i shifted into range, which is off from g(e) by at most one,
+// and the difference is kept as two bits per exponent.
+constexpr int pow10_min = -292;
+constexpr int pow10_max = 326;
+constexpr int pow10_step = 27;
+
+static constexpr uint64_t pow10_bases[][2] = {
+    {0xff77b1fcbebcdc4full, 0x25e8e89c13bb0f7bull},
+    {0xce5d73ff402d98e3ull, 0xfb0a3d212dc81290ull},
+    {0xa6b34ad8c9dfc06full, 0xf42faa48c0ea481full},
+    {0x86a8d39ef77164bcull, 0xae5dff9c02033198ull},
+    {0xd98ddaee19068c76ull, 0x3badd624dd9b0958ull},
+    {0xafbd2350644eeacfull, 0xe5d1929ef90898fbull},
+    {0x8df5efabc5979c8full, 0xca8d3ffa1ef463c2ull},
+    {0xe55990879ddcaabdull, 0xcc420a6a101d0516ull},
+    {0xb94470938fa89bceull, 0xf808e40e8d5b3e6aull},
+    {0x95a8637627989aadull, 0xdde7001379a44aa9ull},
+    {0xf1c90080baf72cb1ull, 0x5324c68b12dd6339ull},
+    {0xc350000000000000ull, 0x0000000000000001ull},
+    {0x9dc5ada82b70b59dull, 0xf020000000000001ull},
+    {0xfee50b7025c36a08ull, 0x02f236d04753d5b5ull},
+    {0xcde6fd5e09abcf26ull, 0xed4c0226b55e6f87ull},
+    {0xa6539930bf6bff45ull, 0x84db8346b786151dull},
+    {0x865b86925b9bc5c2ull, 0x0b8a2392ba45a9b3ull},
+    {0xd910f7ff28069da4ull, 0x1b2ba1518094da05ull},
+    {0xaf58416654a6babbull, 0x387ac8d1970027b3ull},
+    {0x8da471a9de737e24ull, 0x5ceaecfed289e5d3ull},
+    {0xe4d5e82392a40515ull, 0x0fabaf3feaa5334bull},
+    {0xb8da1662e7b00a17ull, 0x3d6a751f3b936244ull},
+    {0x95527a5202df0ccbull, 0x0f37801e0c43ebc9ull},
+};
+static constexpr uint64_t pow10_corrections[] = {
+    0xa95aaa9aa965aa59ull, 0xaaaa996aaa5aa6aaull,
+    0x50415106a5a6aaa6ull, 0x5965995aa5154114ull,
+    0x5a559556aa565559ull, 0xa6959a96a6aaa999ull,
+    0x6aa9aa9aaa695aaaull, 0x5654516aa9aaaaaaull,
+    0x5665696a95556955ull, 0x69a69a69a696aa59ull,
+    0x565965965965955aull, 0x9a9a9665699aaaa9ull,
+    0xa59996a9aaaaa6aaull, 0x155555956965566aull,
+    0xaa9a69aaa9556555ull, 0x5545455555865aa6ull,
+    0x6956aa96a9a695a4ull, 0xaa69656a695aaa66ull,
+    0x6a6a655aaaaaaaaaull, 0x000000000026aaa9ull,
+};
+
+struct pow5_table {
+    uint64_t data[pow10_step];
+
+    constexpr pow5_table() : data() {
+        uint64_t p = 1;
+        for(auto& value : data) {
+            value = p;
+            p *= 5;
+        }
+    }
+};
+
+constexpr pow5_table pow5;
+
+uint128 pow10_significand(int e) noexcept {
+    assert(pow10_min <= e && e <= pow10_max);
+    auto n = unsigned(e - pow10_min);
+    auto i = n % pow10_step;
+    const auto* base = pow10_bases[n / pow10_step];
+    if(i == 0)
+        return {base[0], base[1]};
+    auto lo = umul128(base[1], pow5.data[i]);
+    auto hi = umul128(base[0], pow5.data[i]);
+    uint64_t mid = hi.lo + lo.hi;
+    uint64_t top = hi.hi + (mid < hi.lo);
+    // 2 <= shift < 64 and the shifted product fits 128 bits.
+    auto shift =
+        unsigned(floor_log2_pow10(e) - floor_log2_pow10(e - int(i)) - int(i));
+    uint128 g{
+        (top << (64 - shift)) | (mid >> shift),
+        (mid << (64 - shift)) | (lo.lo >> shift)};
+    auto correction = (pow10_corrections[n / 32] >> (n % 32 * 2)) & 3;
+    if(correction == 0)
+        g.hi -= g.lo-- == 0;
+    else if(correction == 2)
+        g.hi += ++g.lo == 0;
+    return g;
+}
+
+// floor(g * cp / 2^128) with its lowest bit set if the dropped part is
+// not zero.
+inline uint64_t round_to_odd(const uint128& g, uint64_t cp) noexcept {
+    auto x = umul128(g.lo, cp);
+    auto y = umul128(g.hi, cp);
+    uint64_t z = y.lo + x.hi;
+    uint64_t y1 = y.hi + (z < y.lo);
+    return y1 | (z > 1);
+}
+
+} // namespace
+
+decimal_fp schubfach_shortest(const double_format_context& dbl) noexcept {
+    assert(dbl.value != 0);
+    const uint64_t c = dbl.significand;
+    const int q = dbl.exponent;
+    uint64_t m;
+    int k;
+    if(-52 <= q && q <= 0 && (c & ((uint64_t(1) << -q) - 1)) == 0) {
+        // Integers below 2^53 are their own shortest representation.
+        m = c >> -q;
+        k = 0;
+    }
+    else {
+        const bool even = (c & 1) == 0;
+        const bool closer = dbl.lower_boundary_is_closer()
+            && q > dbl.min_exponent;
+        // The value and its rounding interval in units of 2^(q-2).
+        const uint64_t cbl = 4 * c - 2 + closer;
+        const uint64_t cb = 4 * c;
+        const uint64_t cbr = 4 * c + 2;
+        k = closer ? floor_log10_three_quarters_pow2(q) : floor_log10_pow2(q);
+        const int h = q + floor_log2_pow10(-k) + 1;
+        const auto g = pow10_significand(-k);
+        // Scaled by 10^-k: 4 * value and the interval bounds.
+        const uint64_t vbl = round_to_odd(g, cbl << h);
+        const uint64_t vb = round_to_odd(g, cb << h);
+        const uint64_t vbr = round_to_odd(g, cbr << h);
+        const uint64_t lower = vbl + !even;
+        const uint64_t upper = vbr - !even;
+        const uint64_t s = vb / 4;
+        bool done = false;
+        if(s >= 10) {
+            // One digit less if a multiple of ten is inside the interval.
+            const uint64_t sp = s / 10;
+            const bool up_inside = lower <= 40 * sp;
+            const bool wp_inside = 40 * sp + 40 <= upper;
+            if(up_inside != wp_inside) {
+                m = sp + wp_inside;
+                ++k;
+                done = true;
+            }
+        }
+        if(!done) {
+            const bool u_inside = lower <= 4 * s;
+            const bool w_inside = 4 * s + 4 <= upper;
+            if(u_inside != w_inside)
+                m = s + w_inside;
+            else {
+                // Both neighbours are inside: take the closer, ties to even.
+                const uint64_t mid = 4 * s + 2;
+                m = s + (vb > mid || (vb == mid && (s & 1) != 0));
+            }
+        }
+    }
+    while(m % 10 == 0) {
+        m /= 10;
+        ++k;
+    }
+    return {m, k};
+}
+
+void schubfach_dtoa(double_format_context& dbl) {
+    auto dec = schubfach_shortest(dbl);
+    auto count = count_digits(dec.significand);
+    write_dec(dbl.digits, count, dec.significand);
+    dbl.digit_count = count;
+    dbl.decimal_point = int(count) + dec.exponent;
+}
+
+} // namespace detail
+} // namespace fmt
+} // namespace univang
@@ -1,10 +1,75 @@
 #pragma once
+#include <climits>
+#include <cstdint>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// SSE2 is part of the x86-64 baseline, so the vector kernel is selected at
+// compile time; define FMT_USE_SSE2=0 to force the scalar one.
+#ifndef FMT_USE_SSE2
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FMT_USE_SSE2 1
+#else
+#define FMT_USE_SSE2 0
+#endif
+#endif
+#if FMT_USE_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 namespace univang {
 namespace fmt {
 namespace detail {
 
 using out_byte_t = format_context::byte;
 
+// Number of bits needed to represent value, 0 for 0.
+inline unsigned bit_width(uint64_t value) noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    return _BitScanReverse64(&index, value) ? unsigned(index) + 1 : 0;
+#else
+    return value == 0 ? 0 : 64 - unsigned(__builtin_clzll(value));
+#endif
+}
+
+// 10^n for n > 0 and 0 for n == 0, so that 0 and 1 count as one digit.
+static constexpr uint64_t zero_or_powers_of_10[20] = {
+    0,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull};
+
+// Number of decimal digits in value: log10 is estimated from the bit width
+// (1233 / 4096 ~ log10(2)) and corrected by a single table compare.
+template<class T>
+unsigned count_digits(T value) noexcept {
+    static_assert(std::is_unsigned_v<T> && sizeof(T) <= sizeof(uint64_t));
+    unsigned t = (bit_width(uint64_t(value) | 1) * 1233) >> 12;
+    return t + 1 - unsigned(uint64_t(value) < zero_or_powers_of_10[t]);
+}
+
 static constexpr char base_100_digits[201] =
     "0001020304050607080910111213141516171819"
     "2021222324252627282930313233343536373839"
@@ -12,137 +77,556 @@ static constexpr char base_100_digits[201] =
     "6061626364656667686970717273747576777879"
     "8081828384858687888990919293949596979899";
 
-template<class Char, class T>
-unsigned write_dec(Char* out, unsigned len, T i) noexcept {
-    unsigned pos = len - 1;
-    while(i >= 100) {
-        auto const num = (i % 100) * 2;
-        i /= 100;
-        out[pos] = Char(base_100_digits[num + 1]);
-        out[pos - 1] = Char(base_100_digits[num]);
-        pos -= 2;
-    }
-    if(i >= 10) {
-        auto const num = i * 2;
-        out[pos] = Char(base_100_digits[num + 1]);
-        --pos;
-        out[pos] = Char(base_100_digits[num]);
-    }
-    else
-        out[pos] = Char('0' + i);
-    return pos;
+template<class Char>
+void write_2_digits(Char* out, unsigned value) noexcept {
+    out[0] = Char(base_100_digits[value * 2]);
+    out[1] = Char(base_100_digits[value * 2 + 1]);
+}
+
+// Writes exactly N digits of value < 10^N, zero filled, front to back without
+// divisions (jeaiii): y = value * 2^32 / 10^k with k = N - 1 or N - 2 keeps
+// the leading digits in its high half and the rest as a 32-bit binary
+// fraction, and every further digit pair is the high half of fraction * 100.
+// The reciprocals are rounded up and y is biased by one, which keeps the
+// fraction exact for every value below 2^32 (checked exhaustively).
+template<unsigned N, class Char>
+void write_digits(Char* out, uint32_t value) noexcept {
+    static_assert(N >= 1 && N <= 10);
+    if constexpr(N == 1)
+        out[0] = Char('0' + value);
+    else if constexpr(N == 2)
+        write_2_digits(out, value);
+    else {
+        constexpr unsigned lead = 2 - N % 2;
+        constexpr unsigned k = N - lead;
+        constexpr unsigned shift = k == 8 ? 26 : 25;
+        constexpr uint64_t mul =
+            (uint64_t(1) << (32 + shift)) / zero_or_powers_of_10[k] + 1;
+        uint64_t y = (value * mul >> shift) + 1;
+        if constexpr(lead == 1)
+            out[0] = Char('0' + (y >> 32));
+        else
+            write_2_digits(out, unsigned(y >> 32));
+        for(unsigned i = lead; i < N; i += 2) {
+            y = uint64_t(uint32_t(y)) * 100;
+            write_2_digits(out + i, unsigned(y >> 32));
+        }
+    }
 }
 
+template<class Char>
+void write_dec_u32(Char* out, unsigned len, uint32_t value) noexcept {
+    switch(len) {
+    case 1:
+        return write_digits<1>(out, value);
+    case 2:
+        return write_digits<2>(out, value);
+    case 3:
+        return write_digits<3>(out, value);
+    case 4:
+        return write_digits<4>(out, value);
+    case 5:
+        return write_digits<5>(out, value);
+    case 6:
+        return write_digits<6>(out, value);
+    case 7:
+        return write_digits<7>(out, value);
+    case 8:
+        return write_digits<8>(out, value);
+    case 9:
+        return write_digits<9>(out, value);
+    default:
+        return write_digits<10>(out, value);
+    }
+}
+
+#if FMT_USE_SSE2
+// Converts value < 10^8 to its eight decimal digits, one per 16-bit lane:
+// splits it into two 4-digit halves by a multiply-shift, broadcasts each
+// half to four lanes and divides them by 10^3..10^0 with a fixed-point
+// multiply, then subtracts ten times the next higher digit prefix.
+inline __m128i dec8_sse2(uint32_t value) noexcept {
+    const __m128i x = _mm_cvtsi32_si128(int(value));
+    const __m128i abcd =
+        _mm_srli_epi64(_mm_mul_epu32(x, _mm_set1_epi32(int(0xd1b71759))), 45);
+    const __m128i efgh =
+        _mm_sub_epi32(x, _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+    const __m128i v1 = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+    const __m128i v2a = _mm_unpacklo_epi16(v1, v1);
+    const __m128i v2 = _mm_unpacklo_epi32(v2a, v2a);
+    const __m128i div_powers = _mm_setr_epi16(
+        8389, 5243, 13108, short(32768), 8389, 5243, 13108, short(32768));
+    const __m128i shift_powers = _mm_setr_epi16(
+        1 << 7, 1 << 11, 1 << 13, short(1 << 15), 1 << 7, 1 << 11, 1 << 13,
+        short(1 << 15));
+    const __m128i v4 =
+        _mm_mulhi_epu16(_mm_mulhi_epu16(v2, div_powers), shift_powers);
+    const __m128i v6 =
+        _mm_slli_epi64(_mm_mullo_epi16(v4, _mm_set1_epi16(10)), 16);
+    return _mm_sub_epi16(v4, v6);
+}
+
+// ASCII digits of hi * 10^8 + lo, where hi, lo < 10^8.
+inline __m128i dec16_sse2(uint32_t hi, uint32_t lo) noexcept {
+    return _mm_add_epi8(
+        _mm_packus_epi16(dec8_sse2(hi), dec8_sse2(lo)), _mm_set1_epi8('0'));
+}
+
+template<class Char>
+void write_dec_sse2(Char* out, unsigned len, uint64_t i) noexcept;
+#endif
+
+// Writes the len == count_digits(i) digits of i to out.
 template<class Char, class T>
-unsigned write_dec_with_sep(Char* out, unsigned len, T i, char sep) noexcept {
-    unsigned pos = len;
-    size_t n = 0;
-    auto write_sep = [&n, &pos, out, sep] {
-        ++n;
-        if(n == 3) {
-            out[--pos] = Char(sep);
-            n = 0;
+void write_dec(Char* out, unsigned len, T i) noexcept {
+    if constexpr(sizeof(T) <= sizeof(uint32_t))
+        write_dec_u32(out, len, uint32_t(i));
+    else {
+        constexpr uint64_t e8 = 100000000;
+#if FMT_USE_SSE2
+        // Below 15 digits the scalar kernel is as fast as the vector one.
+        if(i >= 100000000000000)
+            return write_dec_sse2(out, len, uint64_t(i));
+#endif
+        if(uint64_t(i) >> 32 == 0)
+            return write_dec_u32(out, len, uint32_t(i));
+        auto lo = uint32_t(uint64_t(i) % e8);
+        auto hi = uint64_t(i) / e8;
+        if(hi >> 32 == 0)
+            write_dec_u32(out, len - 8, uint32_t(hi));
+        else {
+            write_dec_u32(out, len - 16, uint32_t(hi / e8));
+            write_digits<8>(out + len - 16, uint32_t(hi % e8));
         }
-    };
-    while(i >= 100) {
-        auto const num = (i % 100) * 2;
-        i /= 100;
-        out[--pos] = Char(base_100_digits[num + 1]);
-        write_sep();
-        out[--pos] = Char(base_100_digits[num]);
-        write_sep();
-    }
-    if(i >= 10) {
-        auto const num = i * 2;
-        out[--pos] = Char(base_100_digits[num + 1]);
-        write_sep();
-        out[--pos] = Char(base_100_digits[num]);
+        write_digits<8>(out + len - 8, lo);
+    }
+}
+
+#if FMT_USE_SSE2
+// Converts the low 16 digits with the vector kernel and the rest, if any, with
+// the scalar one.
+template<class Char>
+void write_dec_sse2(Char* out, unsigned len, uint64_t i) noexcept {
+    constexpr uint64_t e8 = 100000000;
+    constexpr uint64_t e16 = e8 * e8;
+    if(i >= e16) {
+        auto low = i % e16;
+        auto digits = dec16_sse2(uint32_t(low / e8), uint32_t(low % e8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + len - 16), digits);
+        return write_dec_u32(out, len - 16, uint32_t(i / e16));
     }
+    alignas(16) char tmp[16];
+    _mm_store_si128(
+        reinterpret_cast<__m128i*>(tmp),
+        dec16_sse2(uint32_t(i / e8), uint32_t(i % e8)));
+    std::memcpy(out, tmp + 16 - len, len);
+}
+#endif
+
+// Writes exactly N digits of value < 10^N, zero filled, with no length
+// computation: up to 9 digits take a single write_digits pass, longer ones
+// are split into blocks of 8 by constant divisions.
+template<unsigned N, class Char, class T>
+void write_dec_fixed(Char* out, T value) noexcept {
+    static_assert(N >= 1 && N <= 20);
+    if constexpr(N <= 9 || (N == 10 && sizeof(T) <= sizeof(uint32_t)))
+        write_digits<N>(out, uint32_t(value));
     else {
-        write_sep();
-        out[--pos] = Char('0' + i);
+        constexpr uint64_t e8 = 100000000;
+        write_dec_fixed<N - 8>(out, uint64_t(value) / e8);
+        write_digits<8>(out + N - 8, uint32_t(uint64_t(value) % e8));
     }
-    return pos;
 }
 
-template<class T>
-unsigned write_int(
-    out_byte_t* out, unsigned len, T i, unsigned base,
-    bool uppercase = false) noexcept {
-    const char* digits = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
-    unsigned pos = len - 1;
-    while(i >= base) {
-        auto const num = i % base;
-        i /= base;
-        out[pos--] = out_byte_t(digits[num]);
+constexpr unsigned max_fixed_digits = 20;
+
+// Writes value zero filled to exactly width digits, where
+// count_digits(value) <= width <= max_fixed_digits.
+template<class Char>
+void write_dec_width(Char* out, unsigned width, uint64_t value) noexcept {
+    switch(width) {
+    case 1:
+        return write_dec_fixed<1>(out, value);
+    case 2:
+        return write_dec_fixed<2>(out, value);
+    case 3:
+        return write_dec_fixed<3>(out, value);
+    case 4:
+        return write_dec_fixed<4>(out, value);
+    case 5:
+        return write_dec_fixed<5>(out, value);
+    case 6:
+        return write_dec_fixed<6>(out, value);
+    case 7:
+        return write_dec_fixed<7>(out, value);
+    case 8:
+        return write_dec_fixed<8>(out, value);
+    case 9:
+        return write_dec_fixed<9>(out, value);
+    case 10:
+        return write_dec_fixed<10>(out, value);
+    case 11:
+        return write_dec_fixed<11>(out, value);
+    case 12:
+        return write_dec_fixed<12>(out, value);
+    case 13:
+        return write_dec_fixed<13>(out, value);
+    case 14:
+        return write_dec_fixed<14>(out, value);
+    case 15:
+        return write_dec_fixed<15>(out, value);
+    case 16:
+        return write_dec_fixed<16>(out, value);
+    case 17:
+        return write_dec_fixed<17>(out, value);
+    case 18:
+        return write_dec_fixed<18>(out, value);
+    case 19:
+        return write_dec_fixed<19>(out, value);
+    default:
+        return write_dec_fixed<20>(out, value);
+    }
+}
+
+// Calls f(size) for each digit group of grouping that has more digits left
+// of it, counting from the right end of count digits.
+template<class F>
+void for_each_group(
+    unsigned count, const digit_grouping& grouping, F&& f) noexcept {
+    int group = 0;
+    for(unsigned i = 0;;) {
+        bool repeat = i == sizeof(grouping.groups) || grouping.groups[i] == 0;
+        if(!repeat)
+            group = grouping.groups[i++];
+        if(group <= 0 || group == CHAR_MAX)
+            return;
+        while(unsigned(group) < count) {
+            f(unsigned(group));
+            count -= unsigned(group);
+            if(!repeat)
+                break;
+        }
+        if(unsigned(group) >= count)
+            return;
+    }
+}
+
+// Size of count digits with the separators of grouping.
+inline unsigned grouped_size(
+    unsigned count, const digit_grouping& grouping) noexcept {
+    int group = grouping.groups[0];
+    if(grouping.groups[1] == 0 && group > 0 && group != CHAR_MAX)
+        return count + (count - 1) / unsigned(group);
+    auto size = count;
+    for_each_group(count, grouping, [&size](unsigned) { ++size; });
+    return size;
+}
+
+// Writes count digits with the separators of grouping, moving whole groups
+// from the right end. Returns the size written.
+template<class Char, class Digit>
+unsigned write_grouped(
+    Char* out, const Digit* digits, unsigned count,
+    const digit_grouping& grouping) noexcept {
+    static_assert(sizeof(Char) == 1 && sizeof(Digit) == 1);
+    auto size = grouped_size(count, grouping);
+    auto pos = size;
+    if(grouping.groups[0] == 3 && grouping.groups[1] == 0) {
+        // Thousands, the common case, with fixed size moves.
+        for(; count > 3; count -= 3) {
+            pos -= 3;
+            std::memcpy(out + pos, digits + count - 3, 3);
+            out[--pos] = Char(grouping.separator);
+        }
+        std::memcpy(out, digits, count);
+        return size;
+    }
+    for_each_group(count, grouping, [&](unsigned group) {
+        pos -= group;
+        count -= group;
+        std::memcpy(out + pos, digits + count, group);
+        out[--pos] = Char(grouping.separator);
+    });
+    std::memcpy(out, digits, count);
+    return size;
+}
+
+// Two hex digits of every byte value.
+struct hex_pair_table {
+    char data[512];
+
+    constexpr explicit hex_pair_table(bool upper) : data() {
+        const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+        for(unsigned i = 0; i < 256; ++i) {
+            data[i * 2] = digits[i >> 4];
+            data[i * 2 + 1] = digits[i & 15];
+        }
+    }
+};
+
+static constexpr hex_pair_table hex_pairs[2] = {
+    hex_pair_table(false), hex_pair_table(true)};
+
+inline uint64_t byteswap(uint64_t value) noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _byteswap_uint64(value);
+#else
+    return __builtin_bswap64(value);
+#endif
+}
+
+#if FMT_USE_SSE2
+// ASCII hex digits of value, most significant first: spreads the nibbles of
+// the byte swapped value over 16 lanes and adds '0', plus the offset to the
+// letters for the lanes above 9.
+inline __m128i hex16_sse2(uint64_t value, bool upper) noexcept {
+    value = byteswap(value);
+    const __m128i x =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&value));
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nibbles = _mm_unpacklo_epi8(
+        _mm_and_si128(_mm_srli_epi16(x, 4), mask), _mm_and_si128(x, mask));
+    const __m128i letters = _mm_and_si128(
+        _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+        _mm_set1_epi8(char((upper ? 'A' : 'a') - '0' - 10)));
+    return _mm_add_epi8(
+        _mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+#endif
+
+// The hex, octal and binary writers fill exactly len digits, so a len above
+// the digit count of i, up to the digit count of T, zero fills the output.
+template<class Char, class T>
+void write_hex(Char* out, unsigned len, T i, bool upper = false) noexcept {
+    auto u = uint64_t(i);
+#if FMT_USE_SSE2
+    if constexpr(sizeof(T) == sizeof(uint64_t)) {
+        if(len > 8) {
+            alignas(16) char tmp[16];
+            _mm_store_si128(
+                reinterpret_cast<__m128i*>(tmp), hex16_sse2(u, upper));
+            std::memcpy(out, tmp + 16 - len, len);
+            return;
+        }
+    }
+#endif
+    const char* pairs = hex_pairs[upper].data;
+    while(len >= 2) {
+        len -= 2;
+        out[len] = Char(pairs[(u & 0xff) * 2]);
+        out[len + 1] = Char(pairs[(u & 0xff) * 2 + 1]);
+        u >>= 8;
+    }
+    if(len != 0)
+        out[0] = Char(pairs[(u & 0xf) * 2 + 1]);
+}
+
+template<class Char, class T>
+void write_oct(Char* out, unsigned len, T i) noexcept {
+    auto u = uint64_t(i);
+    while(len != 0) {
+        out[--len] = Char('0' + (u & 7));
+        u >>= 3;
+    }
+}
+
+// '0' or '1' for each of the 8 bits in its own byte, most significant bit in
+// the lowest byte.
+inline uint64_t bin8(uint64_t bits) noexcept {
+#if defined(__BMI2__)
+    return byteswap(_pdep_u64(bits, 0x0101010101010101ull))
+        + 0x3030303030303030ull;
+#else
+    // Byte j of the product keeps bit 7 - j, then the add moves any set bit
+    // to the top of its byte.
+    auto x = (bits * 0x0101010101010101ull) & 0x0102040810204080ull;
+    x = ((x + 0x7f7f7f7f7f7f7f7full) >> 7) & 0x0101010101010101ull;
+    return x + 0x3030303030303030ull;
+#endif
+}
+
+template<class Char, class T>
+void write_bin(Char* out, unsigned len, T i) noexcept {
+    auto u = uint64_t(i);
+    while(len >= 8) {
+        len -= 8;
+        auto digits = bin8(u & 0xff);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        digits = byteswap(digits);
+#endif
+        std::memcpy(out + len, &digits, sizeof(digits));
+        u >>= 8;
+    }
+    while(len != 0) {
+        out[--len] = Char('0' + (u & 1));
+        u >>= 1;
     }
-    out[pos] = out_byte_t(digits[i]);
-    return pos;
 }
 
 template<class T>
 std::enable_if_t<std::is_unsigned_v<T>> append_dec(format_context& out, T i) {
-    out_byte_t tmp[sizeof(T) * 3];
-    auto pos = write_dec(tmp, sizeof(tmp), i);
-    out.write(tmp + pos, sizeof(tmp) - pos);
+    auto count = count_digits(i);
+    out.ensure(count);
+    write_dec(out.pos(), count, i);
+    out.advance(count);
 }
 
 template<class T>
 std::enable_if_t<std::is_signed_v<T>> append_dec(format_context& out, T i) {
-    format_context::byte tmp[sizeof(T) * 3 + 1];
     const bool neg = i < 0;
     using U = std::make_unsigned_t<T>;
     const U u = neg ? (U)~i + 1u : i;
-    auto pos = write_dec(tmp, sizeof(tmp), u);
+    auto count = count_digits(u);
+    out.ensure(count + 1);
     if(neg)
-        tmp[--pos] = out_byte_t('-');
-    out.write(tmp + pos, sizeof(tmp) - pos);
+        out.add('-');
+    write_dec(out.pos(), count, u);
+    out.advance(count);
+}
+
+// Text size of values joined by sep.
+template<class T>
+size_t joined_size(const T* values, size_t count, size_t sep_size) noexcept {
+    using U = std::make_unsigned_t<T>;
+    size_t size = 0;
+    for(size_t i = 0; i < count; ++i) {
+        const T v = values[i];
+        if constexpr(std::is_signed_v<T>)
+            size += count_digits(v < 0 ? (U)~v + 1u : U(v)) + (v < 0);
+        else
+            size += count_digits(v);
+    }
+    return size + count * sep_size;
+}
+
+// Writes values each preceded by sep, returns past the last byte. SepSize is
+// the size of sep when known at compile time, which turns its copy into a
+// single store instead of a memcpy call per value.
+template<size_t SepSize, class T>
+out_byte_t* write_joined(
+    out_byte_t* out, const T* values, size_t count,
+    std::string_view sep) noexcept {
+    using U = std::make_unsigned_t<T>;
+    const size_t sep_size = SepSize != size_t(-1) ? SepSize : sep.size();
+    for(size_t i = 0; i < count; ++i) {
+        std::memcpy(out, sep.data(), sep_size);
+        out += sep_size;
+        const T v = values[i];
+        auto u = U(v);
+        if constexpr(std::is_signed_v<T>) {
+            *out = out_byte_t('-');
+            out += v < 0;
+            u = v < 0 ? (U)~v + 1u : u;
+        }
+        auto len = count_digits(u);
+        write_dec(out, len, u);
+        out += len;
+    }
+    return out;
+}
+
+template<class T>
+out_byte_t* write_joined(
+    out_byte_t* out, const T* values, size_t count,
+    std::string_view sep) noexcept {
+    switch(sep.size()) {
+    case 1:
+        return write_joined<1>(out, values, count, sep);
+    case 2:
+        return write_joined<2>(out, values, count, sep);
+    default:
+        return write_joined<size_t(-1)>(out, values, count, sep);
+    }
 }
 
+// Appends values separated by sep. Sizes all of them first so that a
+// growable context reserves once and the digits are converted in a single
+// pass; bounded contexts are filled in parts of what ensure() provides.
 template<class T>
+void append_join(
+    format_context& out, const T* values, size_t count,
+    std::string_view sep) {
+    if(count == 0)
+        return;
+    // Size of the output left after the first value.
+    auto total = joined_size(values + 1, count - 1, sep.size());
+    out.ensure(joined_size(values, 1, 0) + total);
+    append_dec(out, values[0]);
+    for(size_t i = 1; i < count;) {
+        out.ensure((std::min)(total, format_context::max_ensure_size));
+        auto available = out.capacity() - out.size();
+        size_t n = count - i;
+        if(available < total) {
+            n = 0;
+            for(size_t size = 0; i + n < count; ++n) {
+                size += joined_size(values + i + n, 1, sep.size());
+                if(size > available)
+                    break;
+            }
+        }
+        if(n == 0) {
+            total -= joined_size(values + i, 1, sep.size());
+            out.write(sep);
+            append_dec(out, values[i++]);
+        }
+        else {
+            auto* end = write_joined(out.pos(), values + i, n, sep);
+            total -= size_t(end - out.pos());
+            out.advance(size_t(end - out.pos()));
+            i += n;
+        }
+    }
+}
+
+// Upper bound of format_num() output for T, not counting the width padding.
+template<class T>
+constexpr size_t max_num_size = sizeof(T) * 8 + 3;
+
+template<class Out, class T>
 bool format_num(
-    format_context& out, const format_spec& spec, T arg,
-    bool negative = false) {
+    Out& out, const format_spec& spec, T arg, bool negative = false) {
     char sign = negative ? '-' : (spec.sign == '-') ? 0 : spec.sign;
-    out_byte_t tmp[sizeof(T) * 8];
-    size_t pos;
+    unsigned size;
+    unsigned count = 0;
+    const digit_grouping* grouping = nullptr;
     auto alt = spec.alt;
     switch(spec.type) {
     case 0:
     case 'd':
         alt = false;
-        pos = write_dec(tmp, sizeof(tmp), arg);
+        size = count_digits(arg);
         break;
     case 'n':
         alt = false;
-        pos = write_dec_with_sep(tmp, sizeof(tmp), arg, ',');
+        grouping = &get_digit_grouping();
+        count = count_digits(arg);
+        size = grouped_size(count, *grouping);
         break;
     case 'b':
     case 'B':
-        pos = write_int(tmp, sizeof(tmp), arg, 2);
+        size = bit_width(arg | 1);
         break;
     case 'o':
-        pos = write_int(tmp, sizeof(tmp), arg, 8);
+        size = (bit_width(arg | 1) + 2) / 3;
         break;
     case 'x':
     case 'X':
-        pos = write_int(tmp, sizeof(tmp), arg, 16, spec.type == 'X');
+        size = (bit_width(arg | 1) + 3) / 4;
         break;
     default:
         return false;
     }
-    size_t size = sizeof(tmp) - pos;
-    std::string_view num_str{(char*)tmp + pos, size};
+    const unsigned num_size = size;
     size += (sign != 0);
     if(alt)
         size += spec.type == 'o' ? 1 : 2;
     auto padding = (spec.width <= size) ? 0u : spec.width - unsigned(size);
-    out.ensure(size + padding);
     auto fill = spec.fill ? spec.fill : ' ';
     if(spec.align == '>' || !spec.align)
-        out.add_padding(fill, padding);
+        out.write_padding(fill, padding);
     else if(spec.align == '^')
-        out.add_padding(fill, padding / 2);
+        out.write_padding(fill, padding / 2);
+    out.ensure(size);
     if(sign)
         out.add(sign);
     if(alt) {
@@ -150,25 +634,57 @@ bool format_num(
         if(spec.type != 'o')
             out.add(spec.type);
     }
-    if(spec.align == '=')
-        out.add_padding(fill, padding);
-    out.add(num_str);
+    if(spec.align == '=') {
+        if(fill == '0' && (spec.type == 0 || spec.type == 'd')
+           && num_size + padding <= max_fixed_digits) {
+            // The zero padding is part of a single fixed width conversion.
+            out.ensure(num_size + padding);
+            write_dec_width(out.pos(), num_size + padding, uint64_t(arg));
+            out.advance(num_size + padding);
+            return true;
+        }
+        out.write_padding(fill, padding);
+        out.ensure(num_size);
+    }
+    switch(spec.type) {
+    case 'n': {
+        char digits[20];
+        write_dec(digits, count, arg);
+        write_grouped(out.pos(), digits, count, *grouping);
+        break;
+    }
+    case 'b':
+    case 'B':
+        write_bin(out.pos(), num_size, arg);
+        break;
+    case 'o':
+        write_oct(out.pos(), num_size, arg);
+        break;
+    case 'x':
+    case 'X':
+        write_hex(out.pos(), num_size, arg, spec.type == 'X');
+        break;
+    default:
+        write_dec(out.pos(), num_size, arg);
+        break;
+    }
+    out.advance(num_size);
     if(spec.align == '<')
-        out.add_padding(fill, padding);
+        out.write_padding(fill, padding);
     else if(spec.align == '^')
-        out.add_padding(fill, padding - padding / 2);
+        out.write_padding(fill, padding - padding / 2);
     return true;
 }
 
-template<class T>
+template<class Out, class T>
 std::enable_if_t<std::is_unsigned_v<T>, bool> do_format_int(
-    format_context& out, const format_spec& spec, T arg) {
+    Out& out, const format_spec& spec, T arg) {
     return format_num(out, spec, arg, false);
 }
 
-template<class T>
+template<class Out, class T>
 std::enable_if_t<std::is_signed_v<T>, bool> do_format_int(
-    format_context& out, const format_spec& spec, T arg) {
+    Out& out, const format_spec& spec, T arg) {
     const bool negative = arg < 0;
     using U = std::make_unsigned_t<T>;
     const U u = negative ? (U)~arg + 1u : arg;
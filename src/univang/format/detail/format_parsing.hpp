@@ -5,12 +5,17 @@ namespace detail {
 
 class format_parse_context : public parse_context {
 public:
-    format_parse_context(std::string_view str, format_arg_span args) noexcept
-        : parse_context(str), args_(args) {
+    format_parse_context(
+        std::string_view str, format_arg_span args,
+        unsigned last_arg_pos = 0) noexcept
+        : parse_context(str), args_(args), last_arg_pos_(last_arg_pos) {
     }
     unsigned next_arg() {
         return last_arg_pos_++;
     }
+    unsigned last_arg_pos() const {
+        return last_arg_pos_;
+    }
     unsigned arg_count() const {
         return args_.count;
     }
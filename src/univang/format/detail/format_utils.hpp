@@ -13,24 +13,106 @@ inline Dest bit_cast(const Source& source) {
     return dest;
 }
 
-template<class Padded>
-void write_padded(
-    format_context& out, const format_spec& spec, Padded&& value) {
+// Non-virtual writer over space already reserved in a format_context. The
+// write position is kept locally and published back on destruction, so
+// writers instantiated with it compile to plain unchecked stores.
+class unchecked_context {
+public:
+    using byte = format_context::byte;
+
+    explicit unchecked_context(format_context& out) noexcept
+        : out_(out)
+        , pos_(out.data() + out.size())
+        , end_(out.data() + out.capacity()) {
+    }
+    unchecked_context(const unchecked_context&) = delete;
+    unchecked_context& operator=(const unchecked_context&) = delete;
+    ~unchecked_context() {
+        out_.advance(size_t(pos_ - (out_.data() + out_.size())));
+    }
+    size_t available() const noexcept {
+        return size_t(end_ - pos_);
+    }
+    byte* pos() const noexcept {
+        return pos_;
+    }
+    void advance(size_t sz = 1) noexcept {
+        assert(sz <= available());
+        pos_ += sz;
+    }
+    void ensure(size_t add_size) const noexcept {
+        assert(add_size <= available());
+        (void)add_size;
+    }
+    void add(byte b) noexcept {
+        assert(pos_ < end_);
+        *pos_++ = b;
+    }
+    void add(char c) noexcept {
+        assert(pos_ < end_);
+        *pos_++ = byte(c);
+    }
+    void add(const void* p, size_t sz) noexcept {
+        assert(sz <= available());
+        std::memcpy(pos_, p, sz);
+        pos_ += sz;
+    }
+    void add(std::string_view str) noexcept {
+        add(str.data(), str.size());
+    }
+    void add_padding(char c, size_t count) noexcept {
+        assert(count <= available());
+        std::memset(pos_, int(c), count);
+        pos_ += count;
+    }
+    void write(char c) noexcept {
+        add(c);
+    }
+    void write(const void* p, size_t sz) noexcept {
+        add(p, sz);
+    }
+    void write(std::string_view str) noexcept {
+        add(str.data(), str.size());
+    }
+    void write_padding(char c, size_t count) noexcept {
+        add_padding(c, count);
+    }
+
+private:
+    format_context& out_;
+    byte* pos_;
+    byte* end_;
+};
+
+// Runs write(out) on an unchecked_context when max_size bytes are already
+// available, otherwise on the checked format_context.
+template<class Writer>
+void write_reserved(format_context& out, size_t max_size, Writer&& write) {
+    if(out.capacity() - out.size() >= max_size) {
+        unchecked_context reserved(out);
+        write(reserved);
+    }
+    else
+        write(out);
+}
+
+template<class Out, class Padded>
+void write_padded(Out& out, const format_spec& spec, Padded&& value) {
     auto size = value.size();
     if(spec.width <= size)
         return value.write(out);
-    out.ensure(spec.width);
     auto padding = spec.width - unsigned(size);
     auto left_padding =
         spec.align == '<' ? 0 : spec.align == '^' ? padding / 2 : padding;
-    auto right_padding =
-        spec.align == '<' ? padding : spec.align == '^' ? padding - left_padding : 0;
+    auto right_padding = spec.align == '<'
+        ? padding
+        : spec.align == '^' ? padding - left_padding : 0;
     auto fill = spec.fill ? spec.fill : ' ';
     if(left_padding != 0)
-        out.add_padding(fill, left_padding);
+        out.write_padding(fill, left_padding);
     value.write(out);
     if(right_padding != 0)
-        out.add_padding(fill, right_padding);
+        out.write_padding(fill, right_padding);
 }
 
 struct padded_string {
@@ -40,7 +122,8 @@ struct padded_string {
     size_t size() const noexcept {
         return str.size();
     }
-    void write(format_context& out) {
+    template<class Out>
+    void write(Out& out) {
         out.write(str.data(), str.size());
     }
 };
@@ -52,7 +135,8 @@ struct padded_char {
     size_t size() const noexcept {
         return 1;
     }
-    void write(format_context& out) {
+    template<class Out>
+    void write(Out& out) {
         out.write(c);
     }
 };
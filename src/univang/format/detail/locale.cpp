@@ -0,0 +1,27 @@
+#include <univang/format/locale.hpp>
+
+#include <algorithm>
+#include <climits>
+
+namespace univang {
+namespace fmt {
+
+digit_grouping make_digit_grouping(const std::locale& loc) {
+    const auto& facet = std::use_facet<std::numpunct<char>>(loc);
+    digit_grouping result;
+    auto grouping = facet.grouping();
+    auto count = (std::min)(grouping.size(), sizeof(result.groups));
+    for(size_t i = 0; i < sizeof(result.groups); ++i) {
+        // numpunct ends grouping with any size <= 0, here that is CHAR_MAX.
+        if(i < count)
+            result.groups[i] = grouping[i] > 0 ? grouping[i] : CHAR_MAX;
+        else
+            result.groups[i] = 0;
+    }
+    result.separator = facet.thousands_sep();
+    result.decimal_point = facet.decimal_point();
+    return result;
+}
+
+} // namespace fmt
+} // namespace univang
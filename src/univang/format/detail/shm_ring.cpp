@@ -0,0 +1,215 @@
+#include <univang/format/shm_ring.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <new>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace univang {
+namespace fmt {
+
+struct shm_ring::header {
+    uint64_t magic;
+    uint64_t capacity;
+    alignas(64) std::atomic<uint64_t> write_pos;
+    alignas(64) std::atomic<uint64_t> read_pos;
+};
+
+namespace {
+
+constexpr uint64_t ring_magic = 0x676e69722d746d66ull; // "fmt-ring"
+// Every record starts with its size and is aligned to record_align.
+constexpr size_t record_header_size = 8;
+constexpr size_t record_align = 8;
+
+size_t page_size() noexcept {
+    return size_t(::sysconf(_SC_PAGESIZE));
+}
+
+size_t record_size(size_t payload_size) noexcept {
+    return (record_header_size + payload_size + record_align - 1)
+        & ~(record_align - 1);
+}
+
+[[noreturn]] void throw_errno(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Closes the descriptor once the segment is mapped.
+struct fd_guard {
+    int fd;
+    ~fd_guard() {
+        ::close(fd);
+    }
+};
+
+} // namespace
+
+shm_ring shm_ring::create(const char* name, size_t capacity) {
+    auto page = page_size();
+    capacity = (capacity + page - 1) / page * page;
+    int fd = ::shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if(fd < 0)
+        throw_errno("shm_open");
+    fd_guard guard{fd};
+    if(::ftruncate(fd, off_t(page + capacity)) != 0)
+        throw_errno("ftruncate");
+    shm_ring ring(fd, capacity);
+    auto* h = new(ring.base_) header();
+    h->capacity = capacity;
+    h->write_pos.store(0, std::memory_order_relaxed);
+    h->read_pos.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    h->magic = ring_magic;
+    return ring;
+}
+
+shm_ring shm_ring::open(const char* name) {
+    int fd = ::shm_open(name, O_RDWR, 0);
+    if(fd < 0)
+        throw_errno("shm_open");
+    fd_guard guard{fd};
+    struct stat st;
+    if(::fstat(fd, &st) != 0)
+        throw_errno("fstat");
+    auto page = page_size();
+    if(size_t(st.st_size) <= page)
+        throw std::system_error(
+            EINVAL, std::generic_category(), "shm_ring: invalid segment");
+    shm_ring ring(fd, size_t(st.st_size) - page);
+    if(ring.cursors().magic != ring_magic
+       || ring.cursors().capacity != ring.capacity_)
+        throw std::system_error(
+            EINVAL, std::generic_category(), "shm_ring: invalid segment");
+    return ring;
+}
+
+void shm_ring::remove(const char* name) noexcept {
+    ::shm_unlink(name);
+}
+
+shm_ring::shm_ring(int fd, size_t capacity) : capacity_(capacity) {
+    auto page = page_size();
+    mapped_size_ = page + 2 * capacity;
+    // Reserve the address range, then map the segment over it and the data
+    // area once more right after it.
+    auto* base = static_cast<char*>(::mmap(
+        nullptr, mapped_size_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+        0));
+    if(base == MAP_FAILED)
+        throw_errno("mmap");
+    base_ = base;
+    if(::mmap(
+           base, page + capacity, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_FIXED, fd, 0)
+           == MAP_FAILED
+       || ::mmap(
+              base + page + capacity, capacity, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_FIXED, fd, off_t(page))
+           == MAP_FAILED) {
+        int err = errno;
+        ::munmap(base, mapped_size_);
+        throw std::system_error(err, std::generic_category(), "mmap");
+    }
+    data_ = reinterpret_cast<byte*>(base + page);
+}
+
+shm_ring::shm_ring(shm_ring&& rhs) noexcept
+    : base_(rhs.base_)
+    , data_(rhs.data_)
+    , capacity_(rhs.capacity_)
+    , mapped_size_(rhs.mapped_size_) {
+    rhs.base_ = nullptr;
+}
+
+shm_ring& shm_ring::operator=(shm_ring&& rhs) noexcept {
+    assert(this != &rhs);
+    if(base_ != nullptr)
+        ::munmap(base_, mapped_size_);
+    base_ = rhs.base_;
+    data_ = rhs.data_;
+    capacity_ = rhs.capacity_;
+    mapped_size_ = rhs.mapped_size_;
+    rhs.base_ = nullptr;
+    return *this;
+}
+
+shm_ring::~shm_ring() {
+    if(base_ != nullptr)
+        ::munmap(base_, mapped_size_);
+}
+
+shm_ring_context::shm_ring_context(shm_ring& ring) noexcept
+    : ring_(ring)
+    , write_pos_(ring.cursors().write_pos.load(std::memory_order_relaxed))
+    , read_pos_(ring.cursors().read_pos.load(std::memory_order_acquire)) {
+    reset();
+}
+
+void shm_ring_context::reset() noexcept {
+    auto free = ring_.capacity() - size_t(write_pos_ - read_pos_);
+    auto* record = ring_.data() + write_pos_ % ring_.capacity();
+    assign(
+        record + record_header_size,
+        free < record_header_size ? 0 : free - record_header_size);
+}
+
+void shm_ring_context::grow(size_t new_capacity) {
+    if(new_capacity > ring_.capacity() - record_header_size)
+        throw std::length_error("shm_ring record overflow");
+    auto& read_pos = ring_.cursors().read_pos;
+    for(;;) {
+        read_pos_ = read_pos.load(std::memory_order_acquire);
+        auto free = ring_.capacity() - size_t(write_pos_ - read_pos_);
+        if(free >= record_header_size + new_capacity)
+            break;
+        std::this_thread::yield();
+    }
+    reset();
+}
+
+void shm_ring_context::commit() noexcept {
+    if(empty())
+        return;
+    auto size = uint64_t(format_context::size());
+    std::memcpy(data() - record_header_size, &size, sizeof(size));
+    write_pos_ += record_size(size);
+    ring_.cursors().write_pos.store(write_pos_, std::memory_order_release);
+    clear();
+    reset();
+}
+
+shm_ring_reader::shm_ring_reader(shm_ring& ring) noexcept
+    : ring_(ring)
+    , read_pos_(ring.cursors().read_pos.load(std::memory_order_relaxed)) {
+}
+
+std::optional<std::string_view> shm_ring_reader::peek() const noexcept {
+    auto write_pos =
+        ring_.cursors().write_pos.load(std::memory_order_acquire);
+    if(write_pos == read_pos_)
+        return std::nullopt;
+    auto* record = ring_.data() + read_pos_ % ring_.capacity();
+    uint64_t size;
+    std::memcpy(&size, record, sizeof(size));
+    return std::string_view(
+        reinterpret_cast<const char*>(record + record_header_size),
+        size_t(size));
+}
+
+void shm_ring_reader::pop() noexcept {
+    auto record = peek();
+    if(!record)
+        return;
+    read_pos_ += record_size(record->size());
+    ring_.cursors().read_pos.store(read_pos_, std::memory_order_release);
+}
+
+} // namespace fmt
+} // namespace univang
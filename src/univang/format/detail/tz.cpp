@@ -0,0 +1,532 @@
+#include <univang/format/tz.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+
+namespace univang {
+namespace fmt {
+
+namespace {
+
+constexpr int64_t seconds_per_day = 86400;
+
+[[noreturn]] void throw_invalid_tzif() {
+    throw std::runtime_error("invalid TZif file");
+}
+
+std::string read_file(const std::string& path) {
+    auto* file = std::fopen(path.c_str(), "rb");
+    if(file == nullptr)
+        throw std::system_error(errno, std::generic_category(), path);
+    std::string data;
+    char buf[4096];
+    size_t size;
+    while((size = std::fread(buf, 1, sizeof(buf), file)) != 0)
+        data.append(buf, size);
+    int err = std::ferror(file) ? errno : 0;
+    std::fclose(file);
+    if(err != 0)
+        throw std::system_error(err, std::generic_category(), path);
+    return data;
+}
+
+// Big-endian fields of a TZif file.
+class tzif_reader {
+public:
+    explicit tzif_reader(std::string_view data) noexcept : data_(data) {
+    }
+
+    size_t pos() const noexcept {
+        return pos_;
+    }
+    void skip(size_t size) {
+        if(data_.size() - pos_ < size)
+            throw_invalid_tzif();
+        pos_ += size;
+    }
+    std::string_view read(size_t size) {
+        skip(size);
+        return data_.substr(pos_ - size, size);
+    }
+    uint8_t u8() {
+        return uint8_t(read(1)[0]);
+    }
+    uint32_t u32() {
+        uint32_t res = 0;
+        for(char c : read(4))
+            res = res << 8 | uint8_t(c);
+        return res;
+    }
+    uint64_t u64() {
+        uint64_t res = 0;
+        for(char c : read(8))
+            res = res << 8 | uint8_t(c);
+        return res;
+    }
+
+private:
+    std::string_view data_;
+    size_t pos_ = 0;
+};
+
+struct tzif_header {
+    char version;
+    uint32_t isutcnt;
+    uint32_t isstdcnt;
+    uint32_t leapcnt;
+    uint32_t timecnt;
+    uint32_t typecnt;
+    uint32_t charcnt;
+
+    // Size of the data block with time_size byte transition times.
+    size_t data_size(size_t time_size) const noexcept {
+        return timecnt * time_size + timecnt + typecnt * 6 + charcnt
+               + leapcnt * (time_size + 4) + isstdcnt + isutcnt;
+    }
+};
+
+tzif_header read_header(tzif_reader& in) {
+    if(in.read(4) != "TZif")
+        throw_invalid_tzif();
+    tzif_header h;
+    h.version = char(in.u8());
+    in.skip(15);
+    h.isutcnt = in.u32();
+    h.isstdcnt = in.u32();
+    h.leapcnt = in.u32();
+    h.timecnt = in.u32();
+    h.typecnt = in.u32();
+    h.charcnt = in.u32();
+    if(h.typecnt == 0 || h.typecnt > 256 || h.charcnt == 0)
+        throw_invalid_tzif();
+    return h;
+}
+
+constexpr bool is_leap_year(int64_t y) noexcept {
+    return y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+}
+
+// Days from 1970-01-01 to the date of the proleptic Gregorian calendar.
+constexpr int64_t days_from_civil(int64_t y, unsigned m, unsigned d) noexcept {
+    y -= m <= 2;
+    auto era = (y >= 0 ? y : y - 399) / 400;
+    auto yoe = unsigned(y - era * 400);
+    auto doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    auto doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + int64_t(doe) - 719468;
+}
+
+constexpr int64_t year_of(int64_t time) noexcept {
+    auto days = time / seconds_per_day - (time % seconds_per_day < 0);
+    // Civil year of the days, by the inverse of days_from_civil.
+    days += 719468;
+    auto era = (days >= 0 ? days : days - 146096) / 146097;
+    auto doe = unsigned(days - era * 146097);
+    auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    auto mp = (5 * doy + 2) / 153;
+    return int64_t(yoe) + era * 400 + (mp >= 10);
+}
+
+// Parser of the POSIX TZ string in the footer of a TZif file, such as
+// "CET-1CEST,M3.5.0,M10.5.0/3".
+class posix_rule_parser {
+public:
+    using date = detail::tz_rule_date;
+
+    explicit posix_rule_parser(std::string_view s) noexcept : s_(s) {
+    }
+
+    bool eof() const noexcept {
+        return pos_ == s_.size();
+    }
+    bool consume(char c) noexcept {
+        if(eof() || s_[pos_] != c)
+            return false;
+        ++pos_;
+        return true;
+    }
+    bool name(std::string_view& res) noexcept {
+        auto start = pos_;
+        if(consume('<')) {
+            auto end = s_.find('>', pos_);
+            if(end == std::string_view::npos)
+                return false;
+            res = s_.substr(pos_, end - pos_);
+            pos_ = end + 1;
+            return true;
+        }
+        while(!eof() && is_alpha(s_[pos_]))
+            ++pos_;
+        res = s_.substr(start, pos_ - start);
+        return res.size() >= 3;
+    }
+    // [+-]hh[:mm[:ss]], hours up to max_hours.
+    bool time(int32_t& res, int max_hours) noexcept {
+        bool neg = consume('-');
+        if(!neg)
+            consume('+');
+        int h = 0;
+        int m = 0;
+        int sec = 0;
+        if(!number(h, 0, max_hours))
+            return false;
+        if(consume(':')) {
+            if(!number(m, 0, 59))
+                return false;
+            if(consume(':') && !number(sec, 0, 59))
+                return false;
+        }
+        res = h * 3600 + m * 60 + sec;
+        if(neg)
+            res = -res;
+        return true;
+    }
+    bool rule_date(date& res) noexcept {
+        res = {'n', 0, 0, 0, 7200};
+        int a = 0;
+        int b = 0;
+        int c = 0;
+        if(consume('M')) {
+            if(!number(a, 1, 12) || !consume('.') || !number(b, 1, 5)
+               || !consume('.') || !number(c, 0, 6))
+                return false;
+            res.kind = 'M';
+            res.month = unsigned(a);
+            res.week = unsigned(b);
+            res.day = unsigned(c);
+        }
+        else if(consume('J')) {
+            if(!number(a, 1, 365))
+                return false;
+            res.kind = 'J';
+            res.day = unsigned(a);
+        }
+        else if(number(a, 0, 365))
+            res.day = unsigned(a);
+        else
+            return false;
+        // RFC 8536 extends the hours of the time to -167..167.
+        return !consume('/') || time(res.time, 167);
+    }
+
+private:
+    static bool is_alpha(char c) noexcept {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+    bool number(int& res, int min, int max) noexcept {
+        auto start = pos_;
+        res = 0;
+        while(!eof() && s_[pos_] >= '0' && s_[pos_] <= '9' && res <= max)
+            res = res * 10 + (s_[pos_++] - '0');
+        return pos_ != start && res >= min && res <= max;
+    }
+
+    std::string_view s_;
+    size_t pos_ = 0;
+};
+
+// Local time of the rule date in the year y, in seconds since the epoch.
+int64_t rule_time(int64_t y, const detail::tz_rule_date& d) noexcept {
+    auto year_start = days_from_civil(y, 1, 1);
+    int64_t day;
+    if(d.kind == 'J')
+        day = year_start + d.day - 1 + (is_leap_year(y) && d.day >= 60);
+    else if(d.kind == 'n')
+        day = year_start + d.day;
+    else {
+        static constexpr unsigned month_days[] = {
+            31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        auto first = days_from_civil(y, d.month, 1);
+        // 1970-01-01 was a Thursday.
+        auto weekday = unsigned((first % 7 + 11) % 7);
+        auto mday = 1 + (d.day + 7 - weekday) % 7 + 7 * (d.week - 1);
+        auto size = month_days[d.month - 1] + (d.month == 2 && is_leap_year(y));
+        if(mday > size)
+            mday -= 7;
+        day = first + mday - 1;
+    }
+    return day * seconds_per_day + d.time;
+}
+
+time_zone::info make_info(
+    int32_t offset, bool is_dst, std::string_view abbrev) noexcept {
+    time_zone::info res = {offset, is_dst, 0, {}};
+    res.abbrev_size = uint8_t((std::min)(abbrev.size(), sizeof(res.abbrev)));
+    std::memcpy(res.abbrev, abbrev.data(), res.abbrev_size);
+    return res;
+}
+
+std::atomic<uint64_t> next_zone_id{1};
+
+// Interval of a zone found by the last lookup of this thread. Copies share
+// the id and the types, so the type index stays valid for them.
+struct interval_cache {
+    const time_zone* zone = nullptr;
+    uint64_t id = 0;
+    int64_t begin = 0;
+    int64_t end = 0;
+    uint32_t type = 0;
+};
+
+thread_local interval_cache last_interval;
+
+} // namespace
+
+time_zone::time_zone()
+    : id_(next_zone_id++), name_("UTC"), types_{make_info(0, false, "UTC")} {
+}
+
+time_zone::time_zone(std::string name, std::string_view tzif)
+    : id_(next_zone_id++), name_(std::move(name)) {
+    tzif_reader in(tzif);
+    auto header = read_header(in);
+    size_t time_size = 4;
+    if(header.version >= '2') {
+        // Skip the 32-bit data of version 1 readers.
+        in.skip(header.data_size(4));
+        header = read_header(in);
+        time_size = 8;
+    }
+    auto data = in.read(header.data_size(time_size));
+    tzif_reader block(data);
+    transitions_.resize(header.timecnt);
+    for(auto& t : transitions_) {
+        t.time = time_size == 8 ? int64_t(block.u64())
+                                : int64_t(int32_t(block.u32()));
+    }
+    for(auto& t : transitions_) {
+        t.type = block.u8();
+        if(t.type >= header.typecnt)
+            throw_invalid_tzif();
+    }
+    struct tzif_type {
+        int32_t offset;
+        bool is_dst;
+        uint8_t abbrev_index;
+    };
+    std::vector<tzif_type> types(header.typecnt);
+    for(auto& t : types) {
+        t.offset = int32_t(block.u32());
+        t.is_dst = block.u8() != 0;
+        t.abbrev_index = block.u8();
+        if(t.abbrev_index >= header.charcnt)
+            throw_invalid_tzif();
+    }
+    auto chars = block.read(header.charcnt);
+    for(const auto& t : types) {
+        auto abbrev = chars.substr(t.abbrev_index);
+        abbrev = abbrev.substr(0, abbrev.find('\0'));
+        types_.push_back(make_info(t.offset, t.is_dst, abbrev));
+    }
+    for(size_t i = 1; i < transitions_.size(); ++i) {
+        if(transitions_[i].time <= transitions_[i - 1].time)
+            throw_invalid_tzif();
+    }
+    if(time_size == 8 && in.pos() < tzif.size() && in.read(1) == "\n") {
+        auto footer = tzif.substr(in.pos());
+        add_rule_transitions(footer.substr(0, footer.find('\n')));
+    }
+}
+
+// Expands the POSIX TZ rule that applies after the last transition. A rule
+// that does not parse leaves the last transition in effect.
+void time_zone::add_rule_transitions(std::string_view rule) {
+    posix_rule_parser in(rule);
+    std::string_view std_name;
+    std::string_view dst_name;
+    int32_t std_offset = 0;
+    if(!in.name(std_name) || !in.time(std_offset, 24))
+        return;
+    // POSIX offsets are west of UTC.
+    std_offset = -std_offset;
+    // Without daylight saving time the last transition stays in effect.
+    if(in.eof() || !in.name(dst_name))
+        return;
+    int32_t dst_offset = std_offset + 3600;
+    if(!in.consume(',')) {
+        if(!in.time(dst_offset, 24) || !in.consume(','))
+            return;
+        dst_offset = -dst_offset;
+    }
+    posix_rule_parser::date start;
+    posix_rule_parser::date end;
+    if(!in.rule_date(start) || !in.consume(',') || !in.rule_date(end)
+       || !in.eof())
+        return;
+    auto std_type = uint32_t(types_.size());
+    types_.push_back(make_info(std_offset, false, std_name));
+    types_.push_back(make_info(dst_offset, true, dst_name));
+    rule_ = {start, end, std_offset, dst_offset, std_type};
+    has_rule_ = true;
+    int64_t last = transitions_.empty() ? std::numeric_limits<int64_t>::min()
+                                        : transitions_.back().time;
+    int64_t first_year = transitions_.empty() ? 1970 : year_of(last);
+    for(auto y = first_year; y <= max_rule_year; ++y) {
+        transition pair[2];
+        rule_transitions(y, pair);
+        for(const auto& t : pair) {
+            if(t.time <= last)
+                continue;
+            if(!transitions_.empty()
+               && types_[transitions_.back().type].offset
+                      == types_[t.type].offset
+               && types_[transitions_.back().type].is_dst
+                      == types_[t.type].is_dst)
+                continue;
+            transitions_.push_back(t);
+            last = t.time;
+        }
+    }
+}
+
+void time_zone::rule_transitions(
+    int64_t y, transition* pair) const noexcept {
+    // The start is in standard time, the end in daylight saving time.
+    pair[0].time = rule_time(y, rule_.start) - rule_.std_offset;
+    pair[0].type = rule_.std_type + 1;
+    pair[1].time = rule_time(y, rule_.end) - rule_.dst_offset;
+    pair[1].type = rule_.std_type;
+    if(pair[1].time < pair[0].time)
+        std::swap(pair[0], pair[1]);
+}
+
+uint32_t time_zone::rule_type(
+    int64_t t, int64_t& begin, int64_t& end) const noexcept {
+    // The calendar, and so the rule, repeats every 400 years. Far times are
+    // moved back by whole cycles into the 400 years after max_rule_year, so
+    // that the transitions around them do not overflow.
+    constexpr int64_t cycle_years = 400;
+    constexpr int64_t cycle = 146097 * seconds_per_day;
+    auto y = year_of(t);
+    auto cycles = y > max_rule_year ? (y - max_rule_year - 1) / cycle_years
+                                    : 0;
+    int64_t shift = cycles * cycle;
+    y -= cycles * cycle_years;
+    t -= shift;
+    // The local year of a transition may differ from its UTC year.
+    transition around[6];
+    for(int i = 0; i < 3; ++i)
+        rule_transitions(y - 1 + i, around + 2 * i);
+    auto type = transitions_.back().type;
+    begin = std::numeric_limits<int64_t>::min();
+    end = std::numeric_limits<int64_t>::max();
+    for(const auto& tr : around) {
+        if(tr.time <= t && tr.time >= begin) {
+            begin = tr.time;
+            type = tr.type;
+        }
+        else if(tr.time > t && tr.time < end)
+            end = tr.time;
+    }
+    begin = (std::max)(begin + shift, transitions_.back().time);
+    end = end > std::numeric_limits<int64_t>::max() - shift
+              ? std::numeric_limits<int64_t>::max()
+              : end + shift;
+    return type;
+}
+
+const time_zone::info& time_zone::lookup(
+    std::chrono::seconds utc) const noexcept {
+    auto t = utc.count();
+    auto& cache = last_interval;
+    if(cache.zone == this && cache.id == id_ && t >= cache.begin
+       && t < cache.end)
+        return types_[cache.type];
+    auto it = std::upper_bound(
+        transitions_.begin(), transitions_.end(), t,
+        [](int64_t time, const transition& tr) { return time < tr.time; });
+    cache.zone = this;
+    cache.id = id_;
+    // Expanding the rule left transitions, so the table is not empty.
+    if(it == transitions_.end() && has_rule_) {
+        cache.type = rule_type(t, cache.begin, cache.end);
+        return types_[cache.type];
+    }
+    cache.begin = it == transitions_.begin()
+                      ? std::numeric_limits<int64_t>::min()
+                      : it[-1].time;
+    cache.end = it == transitions_.end() ? std::numeric_limits<int64_t>::max()
+                                         : it->time;
+    cache.type = it == transitions_.begin() ? 0 : it[-1].type;
+    return types_[cache.type];
+}
+
+namespace {
+
+struct zone_registry {
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<time_zone>, std::less<>> zones;
+};
+
+zone_registry& registry() {
+    static zone_registry instance;
+    return instance;
+}
+
+std::string zoneinfo_path(std::string_view name) {
+    const char* dir = std::getenv("TZDIR");
+    std::string path = dir != nullptr && *dir != '\0' ? dir
+                                                      : "/usr/share/zoneinfo";
+    path += '/';
+    path += name;
+    return path;
+}
+
+time_zone load_local() {
+    const char* tz = std::getenv("TZ");
+    if(tz == nullptr)
+        return time_zone("localtime", read_file("/etc/localtime"));
+    std::string_view name = tz;
+    if(!name.empty() && name[0] == ':')
+        name.remove_prefix(1);
+    if(!name.empty() && name[0] == '/')
+        return time_zone(std::string(name), read_file(std::string(name)));
+    return time_zone::locate(name);
+}
+
+} // namespace
+
+const time_zone& time_zone::locate(std::string_view name) {
+    if(name.empty() || name[0] == '/' || name.find("..") != name.npos)
+        throw std::invalid_argument("invalid time zone name");
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto it = reg.zones.find(name);
+    if(it == reg.zones.end()) {
+        auto zone = std::make_unique<time_zone>(
+            std::string(name), read_file(zoneinfo_path(name)));
+        it = reg.zones.emplace(std::string(name), std::move(zone)).first;
+    }
+    return *it->second;
+}
+
+const time_zone& time_zone::local() {
+    static const time_zone zone = []() {
+        try {
+            return load_local();
+        }
+        catch(const std::exception&) {
+            return time_zone();
+        }
+    }();
+    return zone;
+}
+
+const time_zone& time_zone::utc() {
+    static const time_zone zone;
+    return zone;
+}
+
+} // namespace fmt
+} // namespace univang
@@ -1,8 +1,11 @@
 #pragma once
 #include <array>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <ctime>
+#include <iterator>
+#include <string>
 #include <string_view>
 #include <type_traits>
 #include <variant>
@@ -26,6 +29,102 @@ struct format_spec {
     char type = 0;
 };
 
+// Digit grouping of the 'n' presentation type.
+struct digit_grouping {
+    // Sizes of the digit groups counted from the decimal point, as in
+    // std::numpunct::grouping(): the last listed size repeats and CHAR_MAX
+    // ends grouping. Sizes past the first 0 are ignored, so {3, 2} is the
+    // Indian "12,34,567" and {} disables grouping.
+    char groups[8] = {3};
+    char separator = ',';
+    char decimal_point = '.';
+};
+
+// Grouping used by {:n}, e.g. from make_digit_grouping() in locale.hpp. It
+// may be set while other threads format; each call keeps a copy for the
+// lifetime of the process, so set it rarely.
+void set_digit_grouping(const digit_grouping& grouping);
+const digit_grouping& get_digit_grouping() noexcept;
+
+// Fixed point decimal mantissa / 10^scale, e.g. {-12345, 2} is -123.45.
+// Formatted from the integer digits without a conversion to double: the
+// default precision is scale, a smaller one rounds half to even.
+struct decimal64 {
+    int64_t mantissa = 0;
+    unsigned scale = 0;
+};
+
+// IEEE binary16 and bfloat16 values held as their bit patterns. The
+// shortest output round trips to the same type; presentations with a
+// precision format the exact value, as for the double it widens to.
+struct float16 {
+    uint16_t bits = 0;
+
+    double to_double() const noexcept {
+        unsigned exponent = bits >> 10 & 0x1f;
+        uint64_t sign = uint64_t(bits >> 15) << 63;
+        uint64_t fraction = bits & 0x3ff;
+        if(exponent == 0) {
+            double value = double(fraction) * 0x1p-24;
+            return sign ? -value : value;
+        }
+        exponent = exponent == 0x1f ? 0x7ff : exponent - 15 + 1023;
+        uint64_t u = sign | uint64_t(exponent) << 52 | fraction << 42;
+        double value;
+        std::memcpy(&value, &u, sizeof(value));
+        return value;
+    }
+};
+
+struct bfloat16 {
+    uint16_t bits = 0;
+
+    double to_double() const noexcept {
+        uint32_t u = uint32_t(bits) << 16;
+        float value;
+        std::memcpy(&value, &u, sizeof(value));
+        return value;
+    }
+};
+
+// Conventions for the shortest round trip output of a double.
+enum class float_style : char {
+    // As {}: "1e+21", "1e-7", "inf", "-0".
+    standard,
+    // Number.prototype.toString(): "1e+21", "Infinity", "0" for -0.
+    ecmascript,
+    // JSON.stringify(): ECMAScript numbers, null for inf and nan.
+    json,
+    // Python repr(): "1.0", "1e-05", "1e+16", "-0.0".
+    python,
+};
+
+namespace detail {
+// Instantiated for every float_style, each with its own constants.
+template<float_style Style>
+void append_double(format_context& out, double value);
+} // namespace detail
+
+// Double formatted in a fixed style, e.g. format("{}", as_json(x)).
+template<float_style Style>
+struct styled_double {
+    double value;
+
+    void format(format_context& out) const {
+        detail::append_double<Style>(out, value);
+    }
+};
+
+inline styled_double<float_style::ecmascript> as_ecmascript(double v) {
+    return {v};
+}
+inline styled_double<float_style::json> as_json(double v) {
+    return {v};
+}
+inline styled_double<float_style::python> as_python(double v) {
+    return {v};
+}
+
 template<class T, class Enable = void>
 struct formatter {
     formatter() = delete;
@@ -41,6 +140,13 @@ void append(format_context& out, unsigned long v);
 void append(format_context& out, long long v);
 void append(format_context& out, unsigned long long v);
 void append(format_context& out, double v);
+void append(format_context& out, long double v);
+#ifdef __SIZEOF_FLOAT128__
+void append(format_context& out, __float128 v);
+#endif
+void append(format_context& out, decimal64 v);
+void append(format_context& out, float16 v);
+void append(format_context& out, bfloat16 v);
 void append(format_context& out, const void* v);
 inline void append(format_context& out, std::string_view v) {
     out.write(v);
@@ -52,6 +158,36 @@ inline void append(format_context& out, bool v) {
     append(out, v ? "true" : "false");
 }
 
+// Append integer arrays joined by sep.
+void append_join(
+    format_context& out, const int* v, size_t count, std::string_view sep);
+void append_join(
+    format_context& out, const unsigned int* v, size_t count,
+    std::string_view sep);
+void append_join(
+    format_context& out, const long* v, size_t count, std::string_view sep);
+void append_join(
+    format_context& out, const unsigned long* v, size_t count,
+    std::string_view sep);
+void append_join(
+    format_context& out, const long long* v, size_t count,
+    std::string_view sep);
+void append_join(
+    format_context& out, const unsigned long long* v, size_t count,
+    std::string_view sep);
+// Append floating point values formatted with the same spec joined by sep,
+// e.g. a CSV column. The spec is checked once; throws std::invalid_argument
+// for a non floating type.
+void format_doubles(
+    format_context& out, const double* v, size_t count,
+    const format_spec& spec, std::string_view sep);
+void format_doubles(
+    format_context& out, const float16* v, size_t count,
+    const format_spec& spec, std::string_view sep);
+void format_doubles(
+    format_context& out, const bfloat16* v, size_t count,
+    const format_spec& spec, std::string_view sep);
+
 template<class T>
 using has_formatter = std::is_constructible<formatter<T>>;
 
@@ -220,9 +356,16 @@ struct format_arg {
             return handle(v);
         }
     };
+    // Values wider than double are held by pointer, as for handle, to keep
+    // format_arg small.
     using value_type = std::variant<
         bool, char, int, unsigned, long long, unsigned long long, double,
-        const char*, std::string_view, const void*, handle>;
+        const long double*,
+#ifdef __SIZEOF_FLOAT128__
+        const __float128*,
+#endif
+        decimal64, float16, bfloat16, const char*, std::string_view,
+        const void*, handle>;
     value_type value;
 
     template<typename T>
@@ -236,6 +379,18 @@ struct format_arg {
     }
     explicit format_arg(double n) noexcept : value(n) {
     }
+    explicit format_arg(const long double& n) noexcept : value(&n) {
+    }
+#ifdef __SIZEOF_FLOAT128__
+    explicit format_arg(const __float128& n) noexcept : value(&n) {
+    }
+#endif
+    explicit format_arg(decimal64 n) noexcept : value(n) {
+    }
+    explicit format_arg(float16 n) noexcept : value(n) {
+    }
+    explicit format_arg(bfloat16 n) noexcept : value(n) {
+    }
     explicit format_arg(const char* s) : value(s) {
     }
     template<class Traits>
@@ -293,6 +448,41 @@ void vappend_to(format_context& out, delim_t delim, format_arg_span args);
 void vformat_to(
     format_context& out, std::string_view format_str, format_arg_span args);
 
+// Pull-based formatting: read() produces the output in caller supplied
+// chunks, resuming where the previous call stopped, also in the middle of an
+// argument. The part of an argument's output past the end of a chunk is kept
+// by the view, up to max_pending_size bytes, for the following reads; so an
+// argument is formatted once unless its output overruns a chunk by more
+// than that, and is then formatted again, skipping the bytes already taken,
+// once the kept ones are read. Memory use is constant. The arguments must
+// outlive the view.
+class format_view {
+public:
+    static constexpr size_t max_pending_size = 4096;
+
+    format_view(std::string_view format_str, format_arg_span args) noexcept
+        : format_str_(format_str), args_(args) {
+    }
+    // Formats the next at most size bytes into buf. Returns 0 at the end.
+    size_t read(char* buf, size_t size);
+    bool done() const noexcept {
+        return done_;
+    }
+
+private:
+    std::string_view format_str_;
+    format_arg_span args_;
+    unsigned last_arg_pos_ = 0;
+    // Output that did not fit into the chunks read so far, from pending_pos_.
+    std::string pending_;
+    size_t pending_pos_ = 0;
+    // Output of the truncated replacement field taken so far.
+    size_t skip_ = 0;
+    // The format string is consumed.
+    bool consumed_ = false;
+    bool done_ = false;
+};
+
 void vappend_to(std::string& str, format_arg_span args);
 void vappend_to(std::string& str, delim_t delim, format_arg_span args);
 void vformat_to(
@@ -321,6 +511,53 @@ inline void append(format_context&& out, delim_t delim, const Args&... args) {
     return vappend_to(out, delim, pack_args(args...));
 }
 
+namespace detail {
+
+// Element types with an append_join() overload.
+template<class T>
+constexpr bool has_append_join = std::is_same_v<T, int>
+    || std::is_same_v<T, unsigned int> || std::is_same_v<T, long>
+    || std::is_same_v<T, unsigned long> || std::is_same_v<T, long long>
+    || std::is_same_v<T, unsigned long long>;
+
+} // namespace detail
+
+// Elements of a contiguous range separated by sep, as formatted by join().
+// Arrays of int and wider standard integers are converted in bulk, other
+// elements one by one with append().
+template<class T>
+struct join_view {
+    const T* first;
+    const T* last;
+    std::string_view sep;
+
+    void format(format_context& out) const {
+        using type = std::remove_cv_t<T>;
+        if constexpr(detail::has_append_join<type>) {
+            append_join(out, first, size_t(last - first), sep);
+        }
+        else {
+            for(auto it = first; it != last; ++it) {
+                if(it != first)
+                    out.write(sep);
+                append(out, *it);
+            }
+        }
+    }
+};
+
+template<class T>
+join_view<T> join(const T* first, const T* last, std::string_view sep) {
+    return {first, last, sep};
+}
+
+// Joins a contiguous range: array, std::array, std::vector, std::string_view.
+template<class Range>
+auto join(const Range& range, std::string_view sep)
+    -> join_view<std::remove_pointer_t<decltype(std::data(range))>> {
+    return {std::data(range), std::data(range) + std::size(range), sep};
+}
+
 template<class... Args>
 inline void format_to(
     format_context& out, std::string_view format_str, const Args&... args) {
@@ -380,6 +617,23 @@ size_t format_to(
     return out.size();
 }
 
+struct format_to_n_result {
+    // Past the last byte stored in the buffer.
+    char* out;
+    // Size of the untruncated output.
+    size_t size;
+};
+
+// Formats into a fixed buffer truncating the output, like snprintf.
+template<class... Args>
+format_to_n_result format_to_n(
+    char* buf, size_t n, std::string_view format_str, const Args&... args) {
+    truncating_format_context out(buf, n);
+    vformat_to(out, format_str, pack_args(args...));
+    auto size = out.finalize();
+    return {buf + out.stored_size(), size};
+}
+
 template<class... Args>
 void assign_format(
     std::string& str, std::string_view format_str, const Args&... args) {
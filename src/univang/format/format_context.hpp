@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstring>
@@ -22,6 +23,16 @@ public:
     }
     format_context(const format_context&) = delete;
     format_context& operator=(const format_context&) = delete;
+
+    // Largest reservation ensure() must satisfy on every context. Bounded
+    // contexts (truncating, streaming) may provide larger amounts only in
+    // parts, so bulk output goes through write() and write_padding().
+    constexpr static size_t max_ensure_size = 512;
+
+    // Makes room for at least min(new_capacity - size(), max_ensure_size)
+    // more bytes. Growable contexts provide all of new_capacity; bounded
+    // ones may flush or redirect the pending output, changing data() and
+    // size().
     virtual void grow(size_t /*new_capacity*/) {
         throw std::length_error("format_context limit overflow");
     }
@@ -57,6 +68,10 @@ public:
     size_t size() const noexcept {
         return size_;
     }
+    // Current write position.
+    byte* pos() const noexcept {
+        return data_ + size_;
+    }
     bool empty() const noexcept {
         return size_ == 0;
     }
@@ -88,7 +103,8 @@ public:
         size_ += count;
     }
     void write_padding(char c, size_t count) {
-        ensure(count);
+        if(capacity_ - size_ < count)
+            return write_padding_chunked(c, count);
         add_padding(c, count);
     }
     void make_c_str() {
@@ -101,7 +117,8 @@ public:
         size_ += sz;
     }
     void write(const void* p, size_t sz) {
-        ensure(sz);
+        if(capacity_ - size_ < sz)
+            return write_chunked(p, sz);
         add(p, sz);
     }
     template<class Char, class Traits>
@@ -115,6 +132,30 @@ public:
         write(str.data(), str.size());
     }
 
+private:
+    void write_chunked(const void* p, size_t sz) {
+        auto* src = static_cast<const byte*>(p);
+        for(;;) {
+            grow(size_ + sz);
+            auto count = (std::min)(sz, capacity_ - size_);
+            add(src, count);
+            sz -= count;
+            if(sz == 0)
+                break;
+            src += count;
+        }
+    }
+    void write_padding_chunked(char c, size_t count) {
+        for(;;) {
+            grow(size_ + count);
+            auto part = (std::min)(count, capacity_ - size_);
+            add_padding(c, part);
+            count -= part;
+            if(count == 0)
+                break;
+        }
+    }
+
 private:
     byte* data_ = nullptr;
     size_t capacity_ = 0;
@@ -145,5 +186,50 @@ private:
 };
 using string_format_context = basic_string_format_context<std::string>;
 
+// Fixed buffer context that never throws on overflow: output past the
+// capacity is dropped and only counted, like snprintf.
+class truncating_format_context : public format_context {
+public:
+    truncating_format_context(void* data, size_t capacity) noexcept
+        : format_context(data, capacity)
+        , buffer_(static_cast<byte*>(data))
+        , buffer_capacity_(capacity) {
+    }
+    void grow(size_t /*new_capacity*/) noexcept final {
+        flush();
+    }
+    // Returns the size the untruncated output would take.
+    size_t finalize() noexcept {
+        flush();
+        return stored_ + dropped_;
+    }
+    // Returns the size of the output stored in the buffer.
+    size_t stored_size() const noexcept {
+        return stored_;
+    }
+
+private:
+    // Moves the pending output to the buffer tail and switches to scratch.
+    void flush() noexcept {
+        if(data() == buffer_)
+            stored_ = size();
+        else {
+            auto count = (std::min)(size(), buffer_capacity_ - stored_);
+            std::memcpy(buffer_ + stored_, scratch_, count);
+            stored_ += count;
+            dropped_ += size() - count;
+        }
+        clear();
+        format_context::assign(scratch_, sizeof(scratch_));
+    }
+
+private:
+    byte* buffer_;
+    size_t buffer_capacity_;
+    size_t stored_ = 0;
+    size_t dropped_ = 0;
+    byte scratch_[max_ensure_size];
+};
+
 } // namespace fmt
 } // namespace univang
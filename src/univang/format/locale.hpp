@@ -0,0 +1,14 @@
+#pragma once
+#include <locale>
+
+#include "format.hpp"
+
+namespace univang {
+namespace fmt {
+
+// Digit grouping, separators and decimal point of the numpunct facet of loc,
+// for set_digit_grouping().
+digit_grouping make_digit_grouping(const std::locale& loc);
+
+} // namespace fmt
+} // namespace univang
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "format_context.hpp"
+
+namespace univang {
+namespace fmt {
+
+// POSIX shared memory ring of formatted records for a single producer and a
+// single consumer process. A header page holds the cursors; the data area
+// is mapped twice back to back, so records wrapping around its end stay
+// contiguous for both sides.
+class shm_ring {
+public:
+    using byte = format_context::byte;
+    struct header;
+
+    // Creates the named segment with at least capacity data bytes.
+    static shm_ring create(const char* name, size_t capacity);
+    // Maps an existing segment.
+    static shm_ring open(const char* name);
+    static void remove(const char* name) noexcept;
+
+    shm_ring(shm_ring&& rhs) noexcept;
+    shm_ring& operator=(shm_ring&& rhs) noexcept;
+    ~shm_ring();
+
+    header& cursors() const noexcept {
+        return *static_cast<header*>(base_);
+    }
+    byte* data() const noexcept {
+        return data_;
+    }
+    size_t capacity() const noexcept {
+        return capacity_;
+    }
+
+private:
+    shm_ring(int fd, size_t capacity);
+
+private:
+    void* base_ = nullptr;
+    byte* data_ = nullptr;
+    size_t capacity_ = 0;
+    size_t mapped_size_ = 0;
+};
+
+// Formats records in place in the ring. Output since the previous commit()
+// forms one record; grow() waits for the consumer to release space.
+class shm_ring_context : public format_context {
+public:
+    explicit shm_ring_context(shm_ring& ring) noexcept;
+
+    void grow(size_t new_capacity) final;
+    // Publishes the output since the previous commit() as one record.
+    void commit() noexcept;
+
+private:
+    void reset() noexcept;
+
+private:
+    shm_ring& ring_;
+    uint64_t write_pos_;
+    uint64_t read_pos_;
+};
+
+// Reads records published by shm_ring_context without copying.
+class shm_ring_reader {
+public:
+    explicit shm_ring_reader(shm_ring& ring) noexcept;
+
+    // Returns the next record or nullopt if none is published. The view
+    // stays valid until pop().
+    std::optional<std::string_view> peek() const noexcept;
+    // Releases the record returned by peek(); does nothing if there is none.
+    void pop() noexcept;
+
+private:
+    shm_ring& ring_;
+    uint64_t read_pos_;
+};
+
+} // namespace fmt
+} // namespace univang
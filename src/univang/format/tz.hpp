@@ -0,0 +1,98 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace univang {
+namespace fmt {
+
+namespace detail {
+
+// Day and local time of a transition of a POSIX TZ rule.
+struct tz_rule_date {
+    char kind; // 'J' Julian day 1-365, 'n' day 0-365, 'M' month rule
+    unsigned day;
+    unsigned week;
+    unsigned month;
+    int32_t time;
+};
+
+// Daylight saving time rule of the POSIX TZ string at the end of a TZif
+// file, in effect after its last transition.
+struct tz_rule {
+    tz_rule_date start;
+    tz_rule_date end;
+    int32_t std_offset;
+    int32_t dst_offset;
+    // Index of the standard time type, followed by the daylight saving one.
+    uint32_t std_type;
+};
+
+} // namespace detail
+
+// Time zone loaded once from a TZif file into a sorted table of transitions.
+// The POSIX TZ rule at the end of the file is expanded into transitions up
+// to max_rule_year, so a lookup is a binary search, mostly skipped by a per
+// thread cache of the interval found last; later times evaluate the rule for
+// their year. Leap second records are ignored.
+class time_zone {
+public:
+    // Offset from UTC and abbreviation of the local time of an interval.
+    struct info {
+        int32_t offset;
+        bool is_dst;
+        uint8_t abbrev_size;
+        char abbrev[10];
+
+        std::string_view abbrev_view() const noexcept {
+            return {abbrev, abbrev_size};
+        }
+    };
+
+    static constexpr int max_rule_year = 2100;
+
+    // Parses the contents of a TZif file.
+    time_zone(std::string name, std::string_view tzif);
+
+    // Loads the zone from $TZDIR or /usr/share/zoneinfo once per process.
+    // Throws std::system_error if the file cannot be read and
+    // std::runtime_error if it is not a valid TZif file.
+    static const time_zone& locate(std::string_view name);
+    // The zone of $TZ, or of /etc/localtime if TZ is not set, UTC if either
+    // cannot be loaded.
+    static const time_zone& local();
+    static const time_zone& utc();
+
+    const std::string& name() const noexcept {
+        return name_;
+    }
+    const info& lookup(std::chrono::seconds utc) const noexcept;
+
+private:
+    struct transition {
+        int64_t time;
+        uint32_t type;
+    };
+
+    time_zone();
+
+    void add_rule_transitions(std::string_view rule);
+    // The two transitions of the rule in the year y, in order.
+    void rule_transitions(int64_t y, transition* pair) const noexcept;
+    // Type of the rule at t past the last transition, and its interval.
+    uint32_t rule_type(int64_t t, int64_t& begin, int64_t& end) const noexcept;
+
+    // Tells apart zones at the address of a destroyed one.
+    uint64_t id_;
+    std::string name_;
+    // Sorted by time; the type of times before the first one is types_[0].
+    std::vector<transition> transitions_;
+    std::vector<info> types_;
+    bool has_rule_ = false;
+    detail::tz_rule rule_ = {};
+};
+
+} // namespace fmt
+} // namespace univang
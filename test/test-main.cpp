@@ -1,6 +1,24 @@
 #include <gtest/gtest.h>
 #include <univang/format/format.hpp>
 
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <univang/format/async_file.hpp>
+#include <univang/format/chrono.hpp>
+#include <univang/format/locale.hpp>
+#include <univang/format/shm_ring.hpp>
+
 namespace fmt = univang::fmt;
 
 TEST(FormatTest, Escaping) {
@@ -34,6 +52,163 @@ TEST(FormatTest, Int) {
     EXPECT_EQ("-1 -1 -1 -1", fmt::format("{0:} {0:+} {0:-} {0: }", -1));
 }
 
+TEST(FormatTest, IntDigits) {
+    uint64_t power = 1;
+    for(int digits = 1; digits <= 20; ++digits) {
+        auto str = std::string(1, '1') + std::string(digits - 1, '0');
+        EXPECT_EQ(str, fmt::format("{}", power));
+        EXPECT_EQ(str, fmt::concat(power));
+        if(digits > 1) {
+            EXPECT_EQ(std::string(digits - 1, '9'), fmt::concat(power - 1));
+        }
+        if(digits < 20)
+            power *= 10;
+    }
+    EXPECT_EQ("0", fmt::concat(0u));
+    EXPECT_EQ(
+        "-9223372036854775808",
+        fmt::concat(std::numeric_limits<long long>::min()));
+    EXPECT_EQ(
+        "18446744073709551615",
+        fmt::format("{}", std::numeric_limits<uint64_t>::max()));
+    EXPECT_EQ(
+        "-2147483648", fmt::format("{}", std::numeric_limits<int>::min()));
+    EXPECT_EQ("0 0 0 0", fmt::format("{0:b} {0:o} {0:x} {0:n}", 0));
+    EXPECT_EQ(
+        "-100 -4 -ff -1,000,000",
+        fmt::format("{0:b} {1:o} {2:x} {3:n}", -4, -4, -255, -1000000));
+    EXPECT_EQ(
+        "18,446,744,073,709,551,615",
+        fmt::format("{:n}", std::numeric_limits<uint64_t>::max()));
+    EXPECT_EQ("-00042", fmt::format("{:06}", -42));
+    EXPECT_EQ("0x00ff", fmt::format("{:#06x}", 255));
+}
+
+// Digit counts around the 8 and 16 digit blocks of the vector kernels, and
+// blocks at the ends of their range.
+TEST(FormatTest, IntBlockBoundaries) {
+    const uint64_t e8 = 100000000;
+    const uint64_t values[] = {e8 / 10, e8 - 1, e8, e8 * 10 - 1,
+                               e8 * e8 / 10, e8 * e8 / 10 + e8 - 1,
+                               e8 * e8 - e8, e8 * e8 - 1, e8 * e8,
+                               e8 * e8 + e8 - 1, e8 * e8 * 10 - 1,
+                               1234567890123456ull};
+    for(auto value : values) {
+        EXPECT_EQ(std::to_string(value), fmt::format("{}", value));
+        EXPECT_EQ(std::to_string(value), fmt::concat(value));
+        auto negative = -static_cast<long long>(value);
+        EXPECT_EQ(std::to_string(negative), fmt::format("{}", negative));
+    }
+}
+
+TEST(FormatTest, ZeroPadded) {
+    const uint64_t values[] = {0, 7, 42, 99999999, 4294967295u,
+                               12345678901234567ull, 18446744073709551615ull};
+    for(auto value : values) {
+        auto digits = std::to_string(value);
+        for(unsigned width = 1; width <= 22; ++width) {
+            auto expected = digits;
+            if(expected.size() < width)
+                expected.insert(0, width - expected.size(), '0');
+            EXPECT_EQ(expected, fmt::format("{:0{}}", value, width));
+        }
+    }
+    EXPECT_EQ("-000000000000000000042", fmt::format("{:022}", -42));
+    EXPECT_EQ("+0042", fmt::format("{:+05}", 42u));
+}
+
+TEST(FormatTest, IntBases) {
+    uint64_t value = 1;
+    for(int bits = 1; bits <= 64; ++bits) {
+        char buf[32];
+        std::snprintf(
+            buf, sizeof(buf), "%llx", static_cast<unsigned long long>(value));
+        EXPECT_EQ(buf, fmt::format("{:x}", value));
+        std::snprintf(
+            buf, sizeof(buf), "%llX", static_cast<unsigned long long>(value));
+        EXPECT_EQ(buf, fmt::format("{:X}", value));
+        std::snprintf(
+            buf, sizeof(buf), "%llo", static_cast<unsigned long long>(value));
+        EXPECT_EQ(buf, fmt::format("{:o}", value));
+        std::string bin;
+        for(int bit = bits - 1; bit >= 0; --bit)
+            bin += char('0' + ((value >> bit) & 1));
+        EXPECT_EQ(bin, fmt::format("{:b}", value));
+        value = (value << 1) | uint64_t(bits & 1);
+    }
+    EXPECT_EQ("7fffffff", fmt::format("{:x}", 0x7fffffff));
+    EXPECT_EQ("0XDEADBEEF", fmt::format("{:#X}", 0xdeadbeefu));
+    EXPECT_EQ("0b1011", fmt::format("{:#b}", 11u));
+    EXPECT_EQ(
+        "0x0000000000000010",
+        fmt::format("{}", reinterpret_cast<const void*>(16)));
+}
+
+TEST(FormatTest, Join) {
+    std::vector<int64_t> values = {0, -1, 42, INT64_MIN, INT64_MAX};
+    EXPECT_EQ(
+        "0, -1, 42, -9223372036854775808, 9223372036854775807",
+        fmt::format("{}", fmt::join(values, ", ")));
+    const uint32_t ids[] = {7, 4294967295u};
+    EXPECT_EQ("[7|4294967295]", fmt::format("[{}]", fmt::join(ids, "|")));
+    EXPECT_EQ("", fmt::concat(fmt::join(std::vector<int>(), ",")));
+    std::string_view words[] = {"a", "b", "c"};
+    EXPECT_EQ("a-b-c", fmt::concat(fmt::join(words, "-")));
+    // Integral types without a bulk conversion go element by element.
+    const char32_t code_points[] = {U'a', U'b'};
+    EXPECT_EQ("97,98", fmt::concat(fmt::join(code_points, ",")));
+
+    std::string expected;
+    values.clear();
+    uint64_t seed = 1;
+    for(int i = 0; i < 10000; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        auto v = int64_t(seed) >> (seed % 64);
+        values.push_back(v);
+        expected += (i != 0 ? ";" : "") + std::to_string(v);
+    }
+    EXPECT_EQ(expected, fmt::concat(fmt::join(values, ";")));
+    std::vector<char> buf(expected.size());
+    auto res = fmt::format_to_n(
+        buf.data(), buf.size() - 10, "{}", fmt::join(values, ";"));
+    EXPECT_EQ(expected.size(), res.size);
+    EXPECT_EQ(
+        expected.substr(0, buf.size() - 10),
+        std::string_view(buf.data(), size_t(res.out - buf.data())));
+}
+
+TEST(FormatTest, Grouping) {
+    const auto previous = fmt::get_digit_grouping();
+    fmt::digit_grouping indian;
+    indian.groups[0] = 3;
+    indian.groups[1] = 2;
+    fmt::set_digit_grouping(indian);
+    EXPECT_EQ("1,23,45,678", fmt::format("{:n}", 12345678));
+    EXPECT_EQ("-123", fmt::format("{:n}", -123));
+    EXPECT_EQ("1,234", fmt::format("{:n}", 1234));
+    EXPECT_EQ("12,34,567.5", fmt::format("{:n}", 1234567.5));
+
+    fmt::digit_grouping german;
+    german.separator = '.';
+    german.decimal_point = ',';
+    fmt::set_digit_grouping(german);
+    EXPECT_EQ("18.446.744.073.709.551.615", fmt::format("{:n}", UINT64_MAX));
+    EXPECT_EQ("1.234.567,25", fmt::format("{:n}", 1234567.25));
+    EXPECT_EQ("1.000.000", fmt::format("{:n}", 1e6));
+    EXPECT_EQ("0,001", fmt::format("{:n}", 0.001));
+    EXPECT_EQ("1,5e+30", fmt::format("{:n}", 1.5e30));
+    EXPECT_EQ("  1.234,57", fmt::format("{:10.6n}", 1234.56789));
+
+    fmt::set_digit_grouping(fmt::make_digit_grouping(std::locale::classic()));
+    EXPECT_EQ("1234567", fmt::format("{:n}", 1234567));
+    EXPECT_EQ("1234.5", fmt::format("{:n}", 1234.5));
+
+    fmt::set_digit_grouping(fmt::digit_grouping());
+    EXPECT_EQ("1,234,567", fmt::format("{:n}", 1234567));
+    EXPECT_EQ("1,234,567.5", fmt::format("{:n}", 1234567.5));
+    fmt::set_digit_grouping(previous);
+}
+
 TEST(DoubleTest, Special) {
     auto nan = std::numeric_limits<double>::quiet_NaN();
     auto inf = std::numeric_limits<double>::infinity();
@@ -44,6 +219,197 @@ TEST(DoubleTest, Special) {
     EXPECT_EQ("nan nan nan nan", fmt::format("{0:} {0:+} {0:-} {0: }", -nan));
 }
 
+TEST(DoubleTest, Column) {
+    std::vector<double> values = {1.5, -0.0, 1e-7, 1e300, -2.5e-8, 42, 0.1};
+    values.push_back(std::numeric_limits<double>::infinity());
+    values.push_back(std::numeric_limits<double>::quiet_NaN());
+    std::string expected;
+    for(size_t i = 0; i < 300; ++i) {
+        auto value = values[i % values.size()] * double(i + 1);
+        values.push_back(value);
+        expected += fmt::format(i != 0 ? ";{:+G}" : "{:+G}", value);
+    }
+    values.erase(values.begin(), values.end() - 300);
+    fmt::format_spec spec;
+    spec.sign = '+';
+    spec.type = 'G';
+    std::string str;
+    fmt::string_format_context out(str);
+    fmt::format_doubles(out, values.data(), values.size(), spec, ";");
+    out.finalize();
+    EXPECT_EQ(expected, str);
+    char buf[100];
+    fmt::truncating_format_context truncated(buf, sizeof(buf));
+    fmt::format_doubles(truncated, values.data(), values.size(), spec, ";");
+    EXPECT_EQ(expected.size(), truncated.finalize());
+    EXPECT_EQ(expected.substr(0, sizeof(buf)), std::string(buf, sizeof(buf)));
+    std::string fixed;
+    fmt::string_format_context fixed_out(fixed);
+    spec.type = 'f';
+    fmt::format_doubles(fixed_out, values.data(), 3, spec, ", ");
+    fixed_out.finalize();
+    EXPECT_EQ("+1.500000, -0.000000, +0.000000", fixed);
+    spec.type = 'd';
+    EXPECT_THROW(
+        fmt::format_doubles(fixed_out, values.data(), 1, spec, ","),
+        std::invalid_argument);
+}
+
+TEST(DoubleTest, Hex) {
+    EXPECT_EQ("0x1.8p+1", fmt::format("{:a}", 3.0));
+    EXPECT_EQ("0x0p+0 -0x0p+0", fmt::format("{:a} {:a}", 0.0, -0.0));
+    EXPECT_EQ("0x1.999999999999ap-4", fmt::format("{:a}", 0.1));
+    EXPECT_EQ("0X1.999AP-4", fmt::format("{:.4A}", 0.1));
+    EXPECT_EQ("0x0.0000000000001p-1022", fmt::format("{:a}", 5e-324));
+    EXPECT_EQ(
+        "0x1.fffffffffffffp+1023",
+        fmt::format("{:a}", std::numeric_limits<double>::max()));
+    // Ties round to even, also into the leading digit.
+    EXPECT_EQ(
+        "0x2p+0 0x1.0p+0 0x1.8000p+0",
+        fmt::format("{:.0a} {:#.1a} {:.4a}", 1.5, 0x1.08p0, 1.5));
+    EXPECT_EQ(
+        "+0x001.8p+1|0x1.8p+1  ",
+        fmt::format("{:+011a}|{:<10a}", 3.0, 3.0));
+    uint64_t seed = 88172645463325252ull;
+    for(int i = 0; i < 10000; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        double value;
+        std::memcpy(&value, &seed, sizeof(value));
+        if(!std::isfinite(value))
+            continue;
+        auto str = fmt::format("{:a}", value);
+        double parsed = std::strtod(str.c_str(), nullptr);
+        EXPECT_EQ(0, std::memcmp(&parsed, &value, sizeof(value))) << str;
+    }
+}
+
+TEST(DoubleTest, Half) {
+    // 0.1 is 0.0999755859375 in binary16 and 0.10009765625 in bfloat16.
+    EXPECT_EQ(
+        "0.1 0.1",
+        fmt::format("{} {}", fmt::float16{0x2e66}, fmt::bfloat16{0x3dcd}));
+    EXPECT_EQ(
+        "0.09998 0.10010", fmt::format(
+            "{:.5f} {:.5f}", fmt::float16{0x2e66}, fmt::bfloat16{0x3dcd}));
+    EXPECT_EQ(
+        "65500 6e-8 -inf 3.39e+38 9e-41", fmt::format(
+            "{} {} {} {} {}", fmt::float16{0x7bff}, fmt::float16{0x0001},
+            fmt::float16{0xfc00}, fmt::bfloat16{0x7f7f},
+            fmt::bfloat16{0x0001}));
+    EXPECT_EQ("  -1.5|", fmt::format("{:>6}|", fmt::float16{0xbe00}));
+    std::vector<fmt::float16> values;
+    std::string expected;
+    for(unsigned bits = 0; bits < 0x10000; bits += 97) {
+        values.push_back(fmt::float16{uint16_t(bits)});
+        expected += fmt::format(bits != 0 ? " {}" : "{}", values.back());
+    }
+    std::string str;
+    fmt::string_format_context out(str);
+    fmt::format_doubles(
+        out, values.data(), values.size(), fmt::format_spec(), " ");
+    out.finalize();
+    EXPECT_EQ(expected, str);
+}
+
+#if defined(__SIZEOF_INT128__) && LDBL_MANT_DIG == 64
+TEST(DoubleTest, LongDouble) {
+    EXPECT_EQ(
+        "0.1 1.189731495357231765e+4932 4e-4951",
+        fmt::format(
+            "{} {} {}", 0.1L, std::numeric_limits<long double>::max(),
+            std::numeric_limits<long double>::denorm_min()));
+    EXPECT_EQ("0x1.999999999999999ap-4", fmt::format("{:a}", 0.1L));
+    std::mt19937_64 rng(7);
+    char buf[256];
+    for(int i = 0; i < 1000; ++i) {
+        auto value = std::ldexp(
+            static_cast<long double>(rng()), int(rng() % 600) - 300);
+        auto str = fmt::format("{}", value);
+        EXPECT_EQ(value, std::strtold(str.c_str(), nullptr)) << str;
+        std::snprintf(buf, sizeof(buf), "%.25Lf", value);
+        EXPECT_EQ(buf, fmt::format("{:.25f}", value));
+        // printf pads the exponent to two digits.
+        std::snprintf(buf, sizeof(buf), "%.20Le", value);
+        auto expected = std::string(buf);
+        auto exponent = std::atoi(buf + expected.find('e') + 1);
+        expected.resize(expected.find('e'));
+        EXPECT_EQ(
+            expected + fmt::format("e{:+}", exponent),
+            fmt::format("{:.20e}", value));
+    }
+}
+#endif
+
+#ifdef __SIZEOF_FLOAT128__
+TEST(DoubleTest, Float128) {
+    __float128 third = __float128(1) / 3;
+    EXPECT_EQ(
+        "0.1 0.3333333333333333333333333333333333",
+        fmt::format("{} {}", __float128(1) / 10, third));
+    EXPECT_EQ(
+        "0.3333333333333333333333333333333333172839",
+        fmt::format("{:.40}", third));
+    EXPECT_EQ(
+        "0x1.5555555555555555555555555555p-2", fmt::format("{:a}", third));
+}
+#endif
+
+TEST(DoubleTest, Styles) {
+    auto inf = std::numeric_limits<double>::infinity();
+    auto nan = std::numeric_limits<double>::quiet_NaN();
+    EXPECT_EQ(
+        "1e+21 1e-7 -Infinity NaN 0 100000000000000000000", fmt::format(
+            "{} {} {} {} {} {}", fmt::as_ecmascript(1e21),
+            fmt::as_ecmascript(1e-7), fmt::as_ecmascript(-inf),
+            fmt::as_ecmascript(nan), fmt::as_ecmascript(-0.0),
+            fmt::as_ecmascript(1e20)));
+    EXPECT_EQ(
+        "[0.5,null,null,-2.5e-7]", fmt::format(
+            "[{},{},{},{}]", fmt::as_json(0.5), fmt::as_json(-inf),
+            fmt::as_json(nan), fmt::as_json(-2.5e-7)));
+    EXPECT_EQ(
+        "1.0 1e-05 0.0001 1e+16 1000000000000000.0 -0.0 -inf 1.5e+300",
+        fmt::format(
+            "{} {} {} {} {} {} {} {}", fmt::as_python(1.0),
+            fmt::as_python(1e-5), fmt::as_python(1e-4),
+            fmt::as_python(1e16), fmt::as_python(1e15),
+            fmt::as_python(-0.0), fmt::as_python(-inf),
+            fmt::as_python(1.5e300)));
+}
+
+TEST(DecimalTest, Format) {
+    EXPECT_EQ("-123.45", fmt::format("{}", fmt::decimal64{-12345, 2}));
+    EXPECT_EQ("0.007", fmt::format("{}", fmt::decimal64{7, 3}));
+    EXPECT_EQ("42", fmt::format("{}", fmt::decimal64{42, 0}));
+    EXPECT_EQ(
+        "-9223372036854775808",
+        fmt::format("{}", fmt::decimal64{INT64_MIN, 0}));
+    EXPECT_EQ(
+        "0.000000009223372036854775807",
+        fmt::format("{}", fmt::decimal64{INT64_MAX, 27}));
+    // Rounding half to even.
+    EXPECT_EQ(
+        "0.12 0.14 0.13 -2 2 -0", fmt::format(
+            "{:.2f} {:.2f} {:.2f} {:.0f} {:.0f} {:.0f}",
+            fmt::decimal64{125, 3}, fmt::decimal64{135, 3},
+            fmt::decimal64{1251, 4}, fmt::decimal64{-25, 1},
+            fmt::decimal64{15, 1}, fmt::decimal64{-4, 1}));
+    EXPECT_EQ("1.5000", fmt::format("{:.4f}", fmt::decimal64{15, 1}));
+    EXPECT_EQ("0", fmt::format("{:.0f}", fmt::decimal64{5, 20}));
+    EXPECT_EQ(
+        "+0012.50|12.50   |  -0.10", fmt::format(
+            "{:+08}|{:<8}|{:7.2f}", fmt::decimal64{1250, 2},
+            fmt::decimal64{1250, 2}, fmt::decimal64{-1, 1}));
+    EXPECT_EQ(
+        "12,345,678.90", fmt::format("{:n}", fmt::decimal64{1234567890, 2}));
+    EXPECT_EQ("7.", fmt::format("{:#}", fmt::decimal64{7, 0}));
+    EXPECT_EQ(
+        "invalid decimal type", fmt::format("{:x}", fmt::decimal64{7, 0}));
+}
+
 TEST(DoubleTest, Zero) {
     EXPECT_EQ("0", fmt::format("{}", 0.0));
 }
@@ -52,6 +418,53 @@ TEST(DoubleTest, Round) {
     EXPECT_EQ(
         "1.9156918820264798e-56", fmt::format("{}", 1.9156918820264798e-56));
     EXPECT_EQ("0.0000", fmt::format("{:.4f}", 7.2809479766055470e-15));
+    // Fractions below 2^-64 take 128 bits in the fast fixed conversion.
+    EXPECT_EQ("0.00000", fmt::format("{:.5f}", 2.2877207391559526e-23));
+    EXPECT_EQ(
+        "0.00000000000000000000",
+        fmt::format("{:.20f}", 2.2877207391559526e-23));
+    EXPECT_EQ("0.00000000000000001500", fmt::format("{:.20f}", 1.5e-17));
+}
+
+TEST(DoubleTest, Shortest) {
+    EXPECT_EQ("5e-324", fmt::format("{}", 5e-324));
+    EXPECT_EQ("2.2250738585072014e-308", fmt::format("{}", 0x1p-1022));
+    EXPECT_EQ(
+        "1.7976931348623157e+308", fmt::format("{}", 1.7976931348623157e308));
+    EXPECT_EQ("9007199254740992", fmt::format("{}", 0x1p53));
+    EXPECT_EQ("1e+23", fmt::format("{}", 1e23));
+    EXPECT_EQ("0.3", fmt::format("{}", 0.3));
+    // Grisu3 could not decide these without a bignum.
+    EXPECT_EQ("776233885735206.2", fmt::format("{}", 776233885735206.2));
+    EXPECT_EQ(
+        "1.5203734505784805e-180", fmt::format("{}", 1.5203734505784805e-180));
+    EXPECT_EQ(
+        "5.570163201297087e-16", fmt::format("{}", 5.570163201297087e-16));
+}
+
+TEST(DoubleTest, Exact) {
+    EXPECT_EQ(
+        "0.100000000000000005551115123126", fmt::format("{:.30f}", 0.1));
+    EXPECT_EQ(
+        "1000000000000000015902891109759918046836080856394528138978132755774"
+        "7838772170381060813469985856815104.000000",
+        fmt::format("{:f}", 1e100));
+    EXPECT_EQ("4.941e-324", fmt::format("{:.3e}", 5e-324));
+    EXPECT_EQ(
+        "4.94065645841246544177e-324", fmt::format("{:.20e}", 5e-324));
+    EXPECT_EQ(
+        "99999999999999991611392.00000000000000000",
+        fmt::format("{:.40g}", 1e23));
+    EXPECT_EQ("1.00e+0", fmt::format("{:.2e}", 1.0));
+    auto min = fmt::format("{:.1074f}", 5e-324);
+    EXPECT_EQ(1076u, min.size());
+    EXPECT_EQ("0.000000", min.substr(0, 8));
+    EXPECT_EQ("19718265533447265625", min.substr(min.size() - 20));
+    // Longer than one reservation of a bounded context.
+    char buf[8];
+    auto res = fmt::format_to_n(buf, sizeof(buf), "{:.1074f}", 5e-324);
+    EXPECT_EQ(1076u, res.size);
+    EXPECT_EQ("0.000000", std::string_view(buf, sizeof(buf)));
 }
 
 TEST(DoubleTest, DoublePrettify) {
@@ -70,6 +483,226 @@ TEST(DoubleTest, ZeroPrecision) {
     EXPECT_EQ("1", fmt::format("{:.0}", 1.0));
 }
 
+TEST(DoubleTest, Width) {
+    EXPECT_EQ("    3.14", fmt::format("{:8.2f}", 3.14159));
+    EXPECT_EQ("3.14    ", fmt::format("{:<8.2f}", 3.14159));
+    EXPECT_EQ("-0003.14", fmt::format("{:08.2f}", -3.14159));
+}
+
+TEST(ChronoTest, Fixed) {
+    using namespace std::chrono;
+    auto tp = system_clock::time_point(
+        seconds(951827696) + duration_cast<system_clock::duration>(
+                                 milliseconds(5)));
+    EXPECT_EQ("2000-02-29T12:34:56.005", fmt::format("{}", tp));
+    EXPECT_EQ(
+        "2000-02-29T12:34:56",
+        fmt::format("{}", system_clock::time_point(seconds(951827696))));
+    EXPECT_EQ(
+        "2000-03-01T00:00:00",
+        fmt::format("{}", system_clock::time_point(seconds(951868800))));
+    EXPECT_EQ(
+        "1969-12-31T23:59:59.999",
+        fmt::format("{}", system_clock::time_point(milliseconds(-1))));
+    EXPECT_EQ(
+        "1900-03-01T00:00:00",
+        fmt::format("{:.0}", system_clock::time_point(seconds(-2203891200))));
+    EXPECT_EQ(
+        "1d 1h 1m 1.000000001s",
+        fmt::format("{}", hours(25) + minutes(1) + nanoseconds(1000000001)));
+    EXPECT_EQ("1.25s", fmt::format("{}", milliseconds(1250)));
+}
+
+TEST(ChronoTest, Spec) {
+    using namespace std::chrono;
+    auto tp = system_clock::time_point(
+        seconds(951827696) + duration_cast<system_clock::duration>(
+                                 milliseconds(5)));
+    EXPECT_EQ(
+        "2000-02-29 12:34:56.005", fmt::format("{:%Y-%m-%d %H:%M:%S.%3f}", tp));
+    EXPECT_EQ(
+        "Tue Feb 29 060 2 12:34:56 PM 02/29/00",
+        fmt::format("{:%a %b %e %j %u %I:%M:%S %p %D}", tp));
+    EXPECT_EQ(
+        "1969-12-31T23:59:59.5%",
+        fmt::format("{:%FT%T.%1f%%}", system_clock::time_point(
+                                          milliseconds(-500))));
+    static constexpr fmt::chrono_spec hm("%R");
+    EXPECT_EQ("12:34 x", fmt::format("{} {}", fmt::with_spec(tp, hm), 'x'));
+    EXPECT_EQ(
+        "-100:01:01.000001",
+        fmt::format("{:%H:%M:%S.%f}", -(hours(100) + seconds(61) +
+                                         microseconds(1))));
+    // Hours of a duration are not bounded by the two digits of %H.
+    char buf[40];
+    auto res = fmt::format_to_n(
+        buf, sizeof(buf), "{:%H%H%H%H%H}", seconds::max());
+    EXPECT_EQ(80u, res.size);
+    EXPECT_EQ(
+        "2562047788015215256204778801521525620477",
+        std::string(buf, sizeof(buf)));
+    std::string hours_spec;
+    for(int i = 0; i < 30; ++i)
+        hours_spec += "%H";
+    EXPECT_EQ(
+        481u,
+        fmt::format("{:" + hours_spec + "}", seconds::min()).size());
+    EXPECT_EQ(
+        "chrono spec too long",
+        fmt::format("{:" + std::string(65, '%') + "}", tp));
+    EXPECT_EQ(
+        "invalid chrono spec", fmt::format("{:%Y-%Q}", tp));
+    EXPECT_EQ(
+        "invalid duration spec", fmt::format("{:%F}", seconds(1)));
+    static constexpr fmt::chrono_spec month("%b");
+    EXPECT_THROW(
+        fmt::format("{}", fmt::with_spec(seconds(1), month)),
+        std::invalid_argument);
+}
+
+TEST(ChronoTest, Precision) {
+    using namespace std::chrono;
+    auto tp = system_clock::time_point(
+        seconds(951827696) + duration_cast<system_clock::duration>(
+                                 milliseconds(5)));
+    EXPECT_EQ("2000-02-29T12:34:56.005000", fmt::format("{:.6}", tp));
+    EXPECT_EQ("2000-02-29T12:34:56", fmt::format("{:.0}", tp));
+    EXPECT_EQ("invalid chrono spec", fmt::format("{:.12}", tp));
+    EXPECT_EQ("1.250s", fmt::format("{:.3}", milliseconds(1250)));
+    EXPECT_EQ("1d 1h 0.000s", fmt::format("{:.3}", hours(25)));
+    EXPECT_EQ("0.0s", fmt::format("{:.1}", seconds(0)));
+    EXPECT_EQ("-1250ms", fmt::format("{:ms}", milliseconds(-1250)));
+    EXPECT_EQ("1.5us", fmt::format("{:us}", nanoseconds(1500)));
+    EXPECT_EQ(
+        "2000000005ns", fmt::format("{:ns}", seconds(2) + nanoseconds(5)));
+    EXPECT_EQ("1.500m", fmt::format("{:.3m}", seconds(90)));
+    EXPECT_EQ("25.5h", fmt::format("{:h}", hours(25) + minutes(30)));
+    EXPECT_EQ("invalid duration spec", fmt::format("{:.3x}", seconds(1)));
+}
+
+TEST(ChronoTest, Zone) {
+    using namespace std::chrono;
+    const fmt::time_zone* berlin;
+    const fmt::time_zone* st_johns;
+    try {
+        berlin = &fmt::time_zone::locate("Europe/Berlin");
+        st_johns = &fmt::time_zone::locate("America/St_Johns");
+    }
+    catch(const std::system_error&) {
+        GTEST_SKIP() << "no zoneinfo";
+    }
+    auto tp = system_clock::time_point(seconds(951827696));
+    EXPECT_EQ(
+        "2000-02-29T13:34:56+01:00",
+        fmt::format("{}", fmt::in_zone(tp, *berlin)));
+    EXPECT_EQ(
+        "2000-02-29 09:04:56 -0330 NST",
+        fmt::format("{:%F %T %z %Z}", fmt::in_zone(tp, *st_johns)));
+    // After the transitions of the file, by its daylight saving time rule.
+    auto summer = system_clock::time_point(seconds(3802550400));
+    EXPECT_EQ(
+        "2090-07-01 02:00 CEST",
+        fmt::format("{:%F %R %Z}", fmt::in_zone(summer, *berlin)));
+    // Past the transitions expanded from the rule.
+    auto far = system_clock::time_point(seconds(5817129142));
+    EXPECT_EQ(
+        "2154-05-03 23:12:22 +0200 CEST",
+        fmt::format("{:%F %T %z %Z}", fmt::in_zone(far, *berlin)));
+    EXPECT_EQ(
+        "+0000 UTC",
+        fmt::format("{:%z %Z}", fmt::in_zone(tp, fmt::time_zone::utc())));
+    EXPECT_EQ("+0000 UTC", fmt::format("{:%z %Z}", tp));
+}
+
+TEST(FormatToNTest, Fits) {
+    char buf[16];
+    auto res = fmt::format_to_n(buf, sizeof(buf), "{}-{}", 42, "abc");
+    EXPECT_EQ(6u, res.size);
+    EXPECT_EQ("42-abc", std::string_view(buf, res.out - buf));
+}
+
+TEST(FormatToNTest, Truncates) {
+    char buf[8];
+    auto res =
+        fmt::format_to_n(buf, sizeof(buf), "{}:{:>10}:{}", 12345, "x", 1.5);
+    EXPECT_EQ(20u, res.size);
+    EXPECT_EQ(buf + sizeof(buf), res.out);
+    EXPECT_EQ("12345:  ", std::string_view(buf, sizeof(buf)));
+
+    std::string long_str(2000, 'a');
+    res = fmt::format_to_n(buf, sizeof(buf), "{}{:*^3000}{}", 7, long_str, 8);
+    EXPECT_EQ(3002u, res.size);
+    EXPECT_EQ("7*******", std::string_view(buf, sizeof(buf)));
+
+    res = fmt::format_to_n(buf, 0, "{}", 123);
+    EXPECT_EQ(3u, res.size);
+    EXPECT_EQ(buf, res.out);
+}
+
+TEST(AsyncFileTest, WritesAll) {
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(nullptr, file);
+    std::string expected;
+    {
+        fmt::async_file_context out(fileno(file), 1000, 3);
+        for(int i = 0; i < 1000; ++i) {
+            fmt::format_to(out, "line {} {:>40}\n", i, "text");
+            fmt::format_to(expected, "line {} {:>40}\n", i, "text");
+        }
+        out.sync();
+        EXPECT_EQ(long(expected.size()), std::ftell(file));
+        out.write(std::string_view(expected));
+    }
+    expected += expected;
+    std::string content(expected.size() + 1, '\0');
+    std::rewind(file);
+    content.resize(std::fread(content.data(), 1, content.size(), file));
+    EXPECT_EQ(expected, content);
+    std::fclose(file);
+}
+
+TEST(ShmRingTest, TwoProcesses) {
+    auto name = fmt::format("/univang-format-test-{}", int(getpid()));
+    auto ring = fmt::shm_ring::create(name.c_str(), 4096);
+    constexpr int count = 5000;
+    auto record = [](int i) {
+        return fmt::format("record {} {:>{}}", i, '|', i % 300);
+    };
+    pid_t pid = fork();
+    ASSERT_NE(-1, pid);
+    if(pid == 0) {
+        auto producer_ring = fmt::shm_ring::open(name.c_str());
+        fmt::shm_ring_context out(producer_ring);
+        for(int i = 0; i < count; ++i) {
+            fmt::format_to(out, "record {} {:>{}}", i, '|', i % 300);
+            out.commit();
+        }
+        _exit(0);
+    }
+    fmt::shm_ring_reader reader(ring);
+    for(int i = 0; i < count; ++i) {
+        auto rec = reader.peek();
+        while(!rec) {
+            std::this_thread::yield();
+            rec = reader.peek();
+        }
+        ASSERT_EQ(record(i), *rec);
+        reader.pop();
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    EXPECT_EQ(0, status);
+    EXPECT_FALSE(reader.peek());
+    // Popping an empty ring leaves the cursor in place.
+    reader.pop();
+    EXPECT_FALSE(reader.peek());
+    fmt::shm_ring_context out(ring);
+    fmt::format_to(out, "last");
+    out.commit();
+    EXPECT_EQ("last", reader.peek().value_or(""));
+    fmt::shm_ring::remove(name.c_str());
+}
+
 constexpr std::string_view color_names[] = {"red", "green", "blue"};
 
 enum color { red, green, blue };
@@ -172,6 +805,83 @@ TEST(FormatTest, MemberFormatParse) {
     EXPECT_EQ("mem{456}", fmt::format("{:y}", s));
 }
 
+TEST(FormatViewTest, Chunks) {
+    std::string long_str(5000, 's');
+    with_formatter custom{123, 456};
+    color3 color{0, 191, 255};
+    const char* format_str = "a{}b{:>300}c{{{}}}{:.3f}|{:y}|{:*^6000}end";
+    auto args = fmt::pack_args(42, "x", color, 3.14159, custom, long_str);
+    std::string expected =
+        fmt::format(format_str, 42, "x", color, 3.14159, custom, long_str);
+    for(size_t chunk : {1, 7, 64, 4096}) {
+        fmt::format_view view(format_str, args);
+        std::string result;
+        std::vector<char> buf(chunk);
+        while(auto n = view.read(buf.data(), buf.size())) {
+            EXPECT_TRUE(n == chunk || view.done());
+            result.append(buf.data(), n);
+        }
+        EXPECT_TRUE(view.done());
+        EXPECT_EQ(expected, result) << "chunk " << chunk;
+    }
+}
+
+struct counted_output {
+    int* calls;
+    void format(fmt::format_context& out) const {
+        ++*calls;
+        out.write_padding('c', 1000);
+    }
+};
+
+TEST(FormatViewTest, FormatsOnce) {
+    int calls = 0;
+    counted_output counted{&calls};
+    auto args = fmt::pack_args(counted, 7);
+    fmt::format_view view("<{}>{}", args);
+    char buf[16];
+    std::string result;
+    while(auto n = view.read(buf, sizeof(buf)))
+        result.append(buf, n);
+    EXPECT_EQ("<" + std::string(1000, 'c') + ">7", result);
+    EXPECT_EQ(1, calls);
+}
+
+struct large_output {
+    int* calls;
+    void format(fmt::format_context& out) const {
+        ++*calls;
+        for(int i = 0; i < 20000; ++i)
+            fmt::append(out, i % 10);
+    }
+};
+
+TEST(FormatViewTest, LargeField) {
+    int calls = 0;
+    large_output large{&calls};
+    auto expected = fmt::format("[{}]", large);
+    calls = 0;
+    auto args = fmt::pack_args(large);
+    fmt::format_view view("[{}]", args);
+    std::vector<char> buf(1000);
+    std::string result;
+    while(auto n = view.read(buf.data(), buf.size()))
+        result.append(buf.data(), n);
+    EXPECT_EQ(expected, result);
+    // Formatted again per chunk and max_pending_size bytes, not per chunk.
+    EXPECT_EQ(4, calls);
+}
+
+TEST(FormatViewTest, Error) {
+    auto args = fmt::pack_args(1);
+    fmt::format_view view("{} {:Q}", args);
+    char buf[4];
+    std::string result;
+    while(auto n = view.read(buf, sizeof(buf)))
+        result.append(buf, n);
+    EXPECT_EQ(fmt::format("{} {:Q}", 1), result);
+}
+
 int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();